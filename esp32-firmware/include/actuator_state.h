@@ -0,0 +1,104 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: actuator_state.h
+ *  Description: Every actuator in one mask – the NCV7240 slots, the outlet
+ *               solenoids and the pump – so a routine states the whole machine
+ *               for a step instead of switching it piece by piece.
+ *               dcApplyActuators() (drink_controller.h) checks the target
+ *               against ACT_INTERLOCKS and sets it in one pass. The named
+ *               states used by the cleaning sequences are checked against the
+ *               same table at compile time.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef ACTUATOR_STATE_H
+#define ACTUATOR_STATE_H
+
+#include <Arduino.h>
+#include "pin_config.h"      // STATION_*_OUTS, TRASH_OUTS, POUR_STATIONS
+#include "board_profile.h"   // BOARD_SLOT_WATER / AIR, BOARD_INGREDIENT_MASK
+
+// Bits 0..31: SPI slot (bit slot - 1). Bits 32..39: outlets (bit 32 = OUT1). Bit 40: pump.
+typedef uint64_t ActuatorMask;
+
+static constexpr uint8_t ACT_OUT_SHIFT = 32;
+static constexpr ActuatorMask ACT_PUMP = 1ull << 40;
+
+static constexpr ActuatorMask actSlot(uint8_t slot) { return 1ull << (slot - 1); }
+static constexpr ActuatorMask actOutlets(uint8_t outMask) { return (ActuatorMask)outMask << ACT_OUT_SHIFT; }
+static constexpr ActuatorMask actOut(uint8_t idx) { return actOutlets((uint8_t)(1u << (idx - 1))); } // OUT1..OUT6
+static constexpr uint32_t actSlotBits(ActuatorMask m) { return (uint32_t)m; }
+static constexpr uint8_t  actOutletBits(ActuatorMask m) { return (uint8_t)(m >> ACT_OUT_SHIFT); }
+
+static constexpr ActuatorMask ACT_WATER       = actSlot(BOARD_SLOT_WATER);
+static constexpr ActuatorMask ACT_AIR         = actSlot(BOARD_SLOT_AIR);   // trash/air valve
+static constexpr ActuatorMask ACT_INGREDIENTS = BOARD_INGREDIENT_MASK;
+
+// Routes (station A; station B adds its own outlets on dual builds)
+static constexpr ActuatorMask ACT_ROUTE_SPOUT = actOutlets(STATION_A_POUR_OUTS);   // OUT1 + OUT3
+static constexpr ActuatorMask ACT_ROUTE_PURGE = actOutlets(STATION_A_PURGE_OUTS);  // OUT1 + OUT4
+static constexpr ActuatorMask ACT_ROUTE_TRASH = actOutlets(TRASH_OUTS);            // OUT2 + OUT4
+
+#if POUR_STATIONS > 1
+static constexpr ActuatorMask ACT_ALL_OUTLETS = actOutlets(0x3F);
+static constexpr ActuatorMask ACT_SPOUTS      = actOutlets((STATION_A_POUR_OUTS & ~STATION_A_PURGE_OUTS) |
+                                                           (STATION_B_POUR_OUTS & ~STATION_B_PURGE_OUTS));
+#else
+static constexpr ActuatorMask ACT_ALL_OUTLETS = actOutlets(0x0F);
+static constexpr ActuatorMask ACT_SPOUTS      = actOutlets(STATION_A_POUR_OUTS & ~STATION_A_PURGE_OUTS); // OUT3
+#endif
+
+/* Forbidden combinations: a state matches a rule when it has every `all` bit,
+ * at least one `any` bit (if any are given) and none of the `none` bits. */
+struct ActInterlock {
+    ActuatorMask all;
+    ActuatorMask any;
+    ActuatorMask none;
+    const char  *why;
+};
+
+static constexpr ActInterlock ACT_INTERLOCKS[] = {
+    { ACT_PUMP,             0,               ACT_ALL_OUTLETS, "pump against closed outlets" },
+    { ACT_PUMP | actOut(2), 0,               actOut(4),       "trash path half-routed (OUT2 without OUT4)" },
+    { actOut(2),            ACT_SPOUTS,      0,               "trash and spout paths open together" },
+    { ACT_AIR,              ACT_SPOUTS,      0,               "trash/air valve open on the spout path" },
+    { ACT_WATER | actOut(3), ACT_INGREDIENTS, 0,              "water into an open bottle line on spout A" },
+#if POUR_STATIONS > 1
+    { ACT_WATER | actOut(6), ACT_INGREDIENTS, 0,              "water into an open bottle line on spout B" },
+#endif
+};
+static constexpr uint8_t ACT_INTERLOCK_COUNT = sizeof(ACT_INTERLOCKS) / sizeof(ACT_INTERLOCKS[0]);
+
+static constexpr bool actMatches(const ActInterlock &r, ActuatorMask m) {
+    return (m & r.all) == r.all && (!r.any || (m & r.any)) && !(m & r.none);
+}
+static constexpr const char *actViolationFrom(ActuatorMask m, uint8_t i) {
+    return i >= ACT_INTERLOCK_COUNT ? nullptr
+         : actMatches(ACT_INTERLOCKS[i], m) ? ACT_INTERLOCKS[i].why
+         : actViolationFrom(m, i + 1);
+}
+// Reason the state is forbidden, or nullptr if it is allowed.
+static constexpr const char *actViolation(ActuatorMask m) { return actViolationFrom(m, 0); }
+
+// Cleaning steps shared by the pour task and the maintenance sequences
+static constexpr ActuatorMask ACT_FLUSH_SPOUT = ACT_WATER | ACT_ROUTE_SPOUT | ACT_PUMP;  // water out of the spout
+static constexpr ActuatorMask ACT_PURGE_TOP   = ACT_ROUTE_PURGE | ACT_PUMP;              // air out of the top
+static constexpr ActuatorMask ACT_RINSE_TRASH = ACT_WATER | ACT_ROUTE_TRASH | ACT_PUMP;  // water to trash
+static constexpr ActuatorMask ACT_DRAIN_TRASH = ACT_AIR | ACT_ROUTE_TRASH | ACT_PUMP;    // air to trash
+static constexpr ActuatorMask ACT_EMPTY_ALL   = ACT_WATER | ACT_AIR | ACT_INGREDIENTS | ACT_ROUTE_TRASH | ACT_PUMP;
+
+static_assert(actViolation(ACT_FLUSH_SPOUT) == nullptr, "water flush breaks an interlock");
+static_assert(actViolation(ACT_PURGE_TOP) == nullptr, "air purge breaks an interlock");
+static_assert(actViolation(ACT_RINSE_TRASH) == nullptr, "trash rinse breaks an interlock");
+static_assert(actViolation(ACT_DRAIN_TRASH) == nullptr, "trash drain breaks an interlock");
+static_assert(actViolation(ACT_EMPTY_ALL) == nullptr, "empty system breaks an interlock");
+static_assert(actViolation(ACT_INGREDIENTS | ACT_ROUTE_SPOUT | ACT_PUMP) == nullptr, "pouring breaks an interlock");
+#if POUR_STATIONS > 1
+static_assert(actViolation(ACT_INGREDIENTS | actOutlets(STATION_B_POUR_OUTS) | ACT_PUMP) == nullptr,
+              "pouring on station B breaks an interlock");
+#endif
+// Every stop path relies on this: all off is never refused
+static_assert(actViolation(0) == nullptr, "all off breaks an interlock");
+
+#endif // ACTUATOR_STATE_H
@@ -2,7 +2,13 @@
 // Flow calibration storage (max 5 rates, linear/log fit)
 void saveFlowCalibrationToNVS(const float *ratesLps, int count, const char *fitType, float a, float b);
 bool loadFlowCalibrationFromNVS(float *ratesLps, int &count, char *fitType, float &a, float &b);
-// Version that increments every time calibration is saved; use to hot-reload cached values
+// Per-slot line multipliers (index 0 = slot 1) and viscosity-class multipliers; missing keys read as 1.0
+void saveFlowScalesToNVS(const float *slotScale, int slotCount, const float *viscScale, int viscCount);
+void loadFlowScalesFromNVS(float *slotScale, int slotCount, float *viscScale, int viscCount);
+// Per-slot fill-level (head pressure) curves, flat [slot][point]; missing slots read as FILL_CURVE_DEFAULT
+void saveFillCurveToNVS(int slotZeroBased, const float *scale, int points);
+void loadFillCurvesFromNVS(float *curves, int slotCount, int points);
+// Version that increments every time calibration (or the slot→ingredient map) is saved; use to hot-reload cached values
 uint32_t getCalibrationVersion();
 #ifndef AWS_MANAGER_H
 #define AWS_MANAGER_H
@@ -27,9 +33,32 @@ uint32_t getCalibrationVersion();
 void setupAWS();
 void processAWSMessages();
 void sendData(const String &topic, const String &message);
+void sendData(const char *topic, const char *message);   // no String copies
 void receiveData(char *topic, byte *payload, unsigned int length);
 void sendHeartbeat();
-void notifyPourResult(bool success, const char *error = nullptr);
+// drink/count (1-based) tag the result of one drink of a batch pour (count > 1).
+// station (1-based) tags results on dual-station builds; 0 = untagged.
+void notifyPourResult(bool success, const char *error = nullptr, uint8_t drink = 0, uint8_t count = 0,
+                      uint8_t station = 0);
+
+/* Queue a publish from a task without touching the MQTT client (copied into a
+ * fixed slot, sent by processAWSMessages() in order). `topic` must be a literal.
+ * Returns false if the queue is full or the message is too long; drops are
+ * counted and logged by processAWSMessages(). */
+bool publishDeferred(const char *topic, const char *msg);
+
+/* Live pour progress. Non-blocking: the latest frame replaces any unsent one
+ * and processAWSMessages() publishes it as { status:"progress", ... } on
+ * AWS_RECEIVE_TOPIC. `phase` must point at a string literal. */
+struct PourProgress {
+    uint8_t     percent;      // 0..100 towards drink ready
+    const char *phase;        // wait_cup | start | pour | flush | purge
+    uint8_t     group;        // current priority group (1-based, 0 outside pour)
+    uint8_t     groups;
+    float       secondsLeft;  // until the drink is ready
+    bool        paused;       // cup removed
+};
+void notifyPourProgress(const PourProgress &p);
 
 /* Volume management helpers (device stores and publishes volumes in liters).
  * Decrement the stored volume for a slot (zero-based index) by ouncesUsed
@@ -49,4 +78,7 @@ void saveVolumesNow();
  */
 float getVolumeLitersForSlot(uint8_t slotZeroBased);
 
+/* Ingredient id (ingredients.json) assigned to a slot (zero-based); 0 = empty. */
+uint16_t getIngredientIdForSlot(uint8_t slotZeroBased);
+
 #endif // AWS_MANAGER_H
@@ -0,0 +1,88 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: board_profile.h
+ *  Description: Compile-time description of the NCV7240 valve chain, selected
+ *               with BOARD_PROFILE (pin_config.h): number of chips, which chip
+ *               and channel drive each SPI slot, and which slots are the water
+ *               feed and the trash/air valve. Ingredient lines are always slots
+ *               1..BOARD_INGREDIENT_SLOTS; water and air follow them. Everything
+ *               here is constexpr, so mapping a slot to its frame bits costs a
+ *               table read at most (nothing at all for constant slots).
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef BOARD_PROFILE_H
+#define BOARD_PROFILE_H
+
+#include <Arduino.h>
+#include "pin_config.h"   // BOARD_PROFILE
+
+struct NcvLine {
+    uint8_t chip;   // 0 = nearest the MCU (its word is shifted out last)
+    uint8_t ch;     // 1..8
+};
+
+#if BOARD_PROFILE == 14
+// Standard PCB, 2 chips: near chip slots 1-6, far chip slots 7-14
+static constexpr uint8_t BOARD_NCV_CHIPS        = 2;
+static constexpr uint8_t BOARD_INGREDIENT_SLOTS = 12;
+static constexpr uint8_t BOARD_SLOT_WATER       = 13;
+static constexpr uint8_t BOARD_SLOT_AIR         = 14;
+static constexpr NcvLine BOARD_NCV_LINES[] = {  // [slot - 1]
+    {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}, {0, 6},
+    {1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8},
+};
+#elif BOARD_PROFILE == 24
+// 3 chips, 8 slots each: 22 ingredient lines + water + air on the far chip
+static constexpr uint8_t BOARD_NCV_CHIPS        = 3;
+static constexpr uint8_t BOARD_INGREDIENT_SLOTS = 22;
+static constexpr uint8_t BOARD_SLOT_WATER       = 23;
+static constexpr uint8_t BOARD_SLOT_AIR         = 24;
+static constexpr NcvLine BOARD_NCV_LINES[] = {
+    {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}, {0, 6}, {0, 7}, {0, 8},
+    {1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8},
+    {2, 1}, {2, 2}, {2, 3}, {2, 4}, {2, 5}, {2, 6}, {2, 7}, {2, 8},
+};
+#elif BOARD_PROFILE == 32
+// 4 chips, 8 slots each: 30 ingredient lines + water + air on the far chip
+static constexpr uint8_t BOARD_NCV_CHIPS        = 4;
+static constexpr uint8_t BOARD_INGREDIENT_SLOTS = 30;
+static constexpr uint8_t BOARD_SLOT_WATER       = 31;
+static constexpr uint8_t BOARD_SLOT_AIR         = 32;
+static constexpr NcvLine BOARD_NCV_LINES[] = {
+    {0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}, {0, 6}, {0, 7}, {0, 8},
+    {1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}, {1, 6}, {1, 7}, {1, 8},
+    {2, 1}, {2, 2}, {2, 3}, {2, 4}, {2, 5}, {2, 6}, {2, 7}, {2, 8},
+    {3, 1}, {3, 2}, {3, 3}, {3, 4}, {3, 5}, {3, 6}, {3, 7}, {3, 8},
+};
+#else
+#error "Unknown BOARD_PROFILE (expected 14, 24 or 32)"
+#endif
+
+// SPI slots 1..BOARD_SPI_SLOTS: ingredients, then water and air
+static constexpr uint8_t BOARD_SPI_SLOTS = sizeof(BOARD_NCV_LINES) / sizeof(BOARD_NCV_LINES[0]);
+
+// Bit (slot - 1) set for every ingredient line
+static constexpr uint32_t BOARD_INGREDIENT_MASK = (1ul << BOARD_INGREDIENT_SLOTS) - 1;
+
+// Table checks (C++11 constexpr: recursion instead of loops)
+static constexpr bool ncvLineFree(uint8_t i, uint8_t j) {
+    return j >= BOARD_SPI_SLOTS ||
+           ((BOARD_NCV_LINES[i].chip != BOARD_NCV_LINES[j].chip || BOARD_NCV_LINES[i].ch != BOARD_NCV_LINES[j].ch) &&
+            ncvLineFree(i, j + 1));
+}
+static constexpr bool ncvLinesValid(uint8_t i) {
+    return i >= BOARD_SPI_SLOTS ||
+           (BOARD_NCV_LINES[i].chip < BOARD_NCV_CHIPS && BOARD_NCV_LINES[i].ch >= 1 && BOARD_NCV_LINES[i].ch <= 8 &&
+            ncvLineFree(i, i + 1) && ncvLinesValid(i + 1));
+}
+
+static_assert(BOARD_SPI_SLOTS <= 8 * BOARD_NCV_CHIPS, "more slots than NCV7240 channels");
+static_assert(BOARD_SPI_SLOTS <= 32, "slot masks are 32 bits wide");
+static_assert(BOARD_SLOT_WATER > BOARD_INGREDIENT_SLOTS && BOARD_SLOT_WATER <= BOARD_SPI_SLOTS &&
+              BOARD_SLOT_AIR > BOARD_INGREDIENT_SLOTS && BOARD_SLOT_AIR <= BOARD_SPI_SLOTS &&
+              BOARD_SLOT_WATER != BOARD_SLOT_AIR, "water/air must be slots after the ingredient lines");
+static_assert(ncvLinesValid(0), "BOARD_NCV_LINES: chip out of range, channel not 1..8, or a channel used twice");
+
+#endif // BOARD_PROFILE_H
@@ -0,0 +1,49 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: clean_policy.h
+ *  Description: Decides how much cleaning runs between consecutive drinks.
+ *               The shared path (manifold, pump, spout) is tracked as a set of
+ *               ingredient slots whose residue may still be in it. Residue is
+ *               harmless when the next drink contains every one of those
+ *               ingredients, so back-to-back identical drinks skip the water
+ *               flush and trash drain; anything else gets a rinse to trash
+ *               before it pours. Perishable ingredients (dairy, purées,
+ *               chocolate) and old residue always get the full clean.
+ *               Pure bookkeeping – drink_controller runs the actual steps.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef CLEAN_POLICY_H
+#define CLEAN_POLICY_H
+
+#include <Arduino.h>
+#include "drink_controller.h"   // IngredientCommand
+
+enum PostPourClean : uint8_t {
+    POST_CLEAN_FULL = 0,   // water flush → air purge top → trash drain (lines end clean)
+    POST_CLEAN_LIGHT       // air purge top only (delivers the remnant; residue stays)
+};
+
+// Ingredient slots 1..BOARD_INGREDIENT_SLOTS used by a recipe, as a bitmask (bit 0 = slot 1).
+uint32_t cleanPolicyMask(const IngredientCommand *cmds, size_t n);
+
+// Before a pour: true if the residue in the line must be rinsed to trash first.
+bool cleanPolicyNeedsRinse(uint32_t nextMask);
+
+// Residue that no drink may keep (too old or perishable) – rinse it while idle.
+bool cleanPolicyResidueStale();
+
+// After a pour: which post-pour clean to run. Does not change state, so the
+// same answer can be used for the ETA before the pour and for the pour itself.
+PostPourClean cleanPolicyAfterPour(uint32_t pouredMask);
+
+// Next order, if already known (batch / queue). 0 = unknown. Cleared by RecordPour.
+void cleanPolicyExpectNext(uint32_t nextMask);
+
+// Bookkeeping once the steps have run.
+void cleanPolicyRecordPour(uint32_t pouredMask, PostPourClean done);
+void cleanPolicyRecordClean();                 // rinse, full clean or maintenance flush
+void cleanPolicyMarkResidue(uint32_t slotMask); // e.g. after priming lines
+
+#endif // CLEAN_POLICY_H
@@ -0,0 +1,39 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: drink_command.h
+ *  Description: Drink command format and its fixed-capacity parsed form. Plain
+ *               C++ (no Arduino), so the native test env builds it on the host.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef DRINK_COMMAND_H
+#define DRINK_COMMAND_H
+
+#include <stdint.h>
+
+struct IngredientCommand {
+    int   slot;     // 1..BOARD_SPI_SLOTS (matches solenoid)
+    float amount;   // ounces
+    int   priority; // lower = earlier group
+};
+
+// Fixed-capacity recipe (no heap): more entries than any recipe uses
+static constexpr uint8_t DRINK_MAX_ITEMS = 16;
+struct DrinkRecipe {
+    IngredientCommand items[DRINK_MAX_ITEMS];
+    uint8_t           count;
+};
+
+// "slot:ounces[:priority],..." parsed in place (priority defaults to 99). Returns
+// false if there were more than DRINK_MAX_ITEMS entries (the rest is dropped).
+bool parseDrinkCommand(const char *commandStr, DrinkRecipe &out);
+
+// Pour groups: the recipe sorted by priority (lower first, in place), then each
+// run of equal priority is poured together.
+void sortByPriority(IngredientCommand *items, uint8_t n);
+
+// Length of the equal-priority run starting at items[0] (0 if n is 0).
+uint8_t priorityGroupLength(const IngredientCommand *items, uint8_t n);
+
+#endif // DRINK_COMMAND_H
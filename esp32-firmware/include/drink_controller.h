@@ -10,45 +10,82 @@
 #define DRINK_CONTROLLER_H
 
 #include <Arduino.h>
-#include <vector>
-#include <String>
-
-struct IngredientCommand {
-    int   slot;     // 1‑16 (matches solenoid)
-    float amount;   // ounces
-    int   priority; // lower = earlier group
-};
+#include <ArduinoJson.h>
+#include "pin_config.h"   // PROGRESS_HZ_DEFAULT, PUMP_SPEED_*
+#include "actuator_state.h"
+#include "drink_command.h" // IngredientCommand, DrinkRecipe, parseDrinkCommand()
 
 // ---------- Init ----------
 void initDrinkController();
 
-// ---------- Parsing ----------
-std::vector<IngredientCommand> parseDrinkCommand(const String &commandStr);
-
 // ---------- Execution (blocking – internal use) ----------
-void dispenseDrink(std::vector<IngredientCommand> &parsedCommand);
+void dispenseDrink(DrinkRecipe &parsedCommand);
 
 // ---------- NEW: kick off non‑blocking pour ----------
 // If overrideNoCup is true, pour proceeds without requiring cup presence.
-void startPourTask(const String &commandStr, bool overrideNoCup = false);
+// progressHz bounds the rate of progress frames (0 = none, max PROGRESS_HZ_MAX).
+// commandRxUs is esp_timer time the command arrived (0 = now), for latency reporting.
+// count > 1 pours the drink count times (max POUR_BATCH_MAX); every drink after the
+// first waits for the cup to be lifted and a fresh one placed on the pad.
+// station (0 = A, 1 = B on dual-station builds) picks the spout path and cup pad;
+// results are then tagged station 1 / 2. Only station A weighs the drink.
+// The stock must already be held with dcReserveStock().
+void startPourTask(const char *commandStr, bool overrideNoCup = false,
+                   uint8_t progressHz = PROGRESS_HZ_DEFAULT, int64_t commandRxUs = 0,
+                   uint8_t count = 1, uint8_t station = 0);
+
+// Housekeeping while IDLE (call from loop): runs deferred cleaning jobs (the trash
+// drain after a full clean, rinsing stale residue) once IDLE_CLEAN_GAP_MS has passed,
+// and clears latched NCV7240 faults left by the last pour/maintenance run.
+void dcIdleService();
+
+// Stop a running idle cleaning job and wait until it has released the pump, valves
+// and outlets (≤ IDLE_CLEAN_POLL_MS). Call before driving hardware from a command.
+void dcIdleJobsPreempt();
+
+// ---------- Estimates (no hardware) ----------
+// Seconds from the "eta" status to the pour result for a recipe string, from the
+// same planner and learned ETA model the pour uses. Returns < 0 if the recipe has
+// no valid ingredient or more than DRINK_MAX_ITEMS entries, or does not fit in
+// ORDER_CMD_MAX. inStock (optional) reports whether tracked volumes cover it.
+float estimateDrinkTime(const char *commandStr, bool *inStock = nullptr);
+
+// ---------- Stock reservation ----------
+// Hold the stock `count` drinks of a recipe will use, so accepted orders cannot
+// over-commit a bottle (checked against volumes minus everything already held).
+// Returns 1 = held, 0 = insufficient, -1 = invalid (as estimateDrinkTime). Call from the
+// MQTT loop before startPourTask() / queueing; the pour task returns the hold
+// drink by drink. dcReleaseStock() gives back a hold for an order never poured.
+int  dcReserveStock(const char *commandStr, uint8_t count = 1);
+void dcReleaseStock(const char *commandStr, uint8_t count = 1);
+
+// Expected seconds until the running pour (incl. rest of a batch) is done; 0 if not pouring.
+float dcPourSecondsLeft();
+
+// The flow model is shared by pours, estimates and the prime plan: hold this lock
+// around any refresh → fill update → plan sequence run outside drink_controller.
+// Not recursive.
+void dcPlanLock();
+void dcPlanUnlock();
 
 // ---------- Cleanup ----------
 void cleanupDrinkController();
 
 // ---------- Lightweight control helpers (for maintenance) ----------
-// Directly control a daisy‑chained NCV7240 slot (1..16). True=open (ON), False=closed (OFF).
-void dcSetSpiSlot(int slot, bool on);
-
-// Set outlet solenoids 1..4 (GPIO controlled). True=ON, False=OFF.
-void dcOutletSetState(bool s1, bool s2, bool s3, bool s4);
-void dcOutletAllOff();
-
+// Set every valve, outlet and the pump at once (actuator_state.h). The target is
+// checked against ACT_INTERLOCKS first; a forbidden one is refused (false) and
+// nothing changes. All off (0) is never refused. pumpPct = % duty when ACT_PUMP is set: soft-starts from off,
+// slews when already running. Flow calibration must run at PUMP_SPEED_POUR.
+bool dcApplyActuators(ActuatorMask m, uint8_t pumpPct = PUMP_SPEED_CLEAN);
+// Current state of all actuators (valves as commanded, outlets, pump running).
+ActuatorMask dcActuators();
 
-// Pump controls (MOSFET). Simple ON/OFF via GPIO.
-void dcPumpOn();
-void dcPumpOff();
+// NCV7240 diagnostics decoded from every frame (fitted slots only):
+// { frames, open_load:[per slot], overload:[per slot], faulted:[slots] } for GET_VALVE_DIAG.
+// Counts are fault onsets since boot.
+void dcValveDiagToJson(JsonObject out);
 
-// Return the number of ingredient slots available based on LIQUORBOT_ID (clamped 0..12).
+// Return the number of ingredient slots available based on LIQUORBOT_ID (clamped 0..BOARD_INGREDIENT_SLOTS).
 uint8_t dcGetIngredientCount();
 
 #endif // DRINK_CONTROLLER_H
@@ -0,0 +1,62 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: eta_model.h
+ *  Description: Self-correcting pour-time model. The planner's makespan only
+ *               covers valve time; the pour task also spends time clearing the
+ *               driver, waiting for the cup, fading the LED, pressurising and
+ *               cleaning. Each pour records what those phases really took and
+ *               the model learns:
+ *                 - a fixed offset per phase (exponential moving average), and
+ *                 - dispense = slope × planned + intercept per priority group
+ *                   (least squares with forgetting).
+ *               Kept in RAM, written to NVS every ETA_SAVE_EVERY pours.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef ETA_MODEL_H
+#define ETA_MODEL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "pin_config.h"   // CLEAN_WATER_MS, CLEAN_AIR_TOP_MS
+
+// Phases between the published "eta" and the drink being ready (pour result)
+enum EtaPhase : uint8_t {
+    ETA_PH_PREP = 0,   // driver fault clear + waiting for the cup
+    ETA_PH_START,      // LED fade, tare, outlets and pump on
+    ETA_PH_CLEAN,      // water flush + top air purge before the result is sent
+    ETA_PHASE_COUNT
+};
+
+static constexpr float   ETA_PHASE_ALPHA  = 0.20f;  // EMA weight of a new phase sample
+static constexpr float   ETA_GROUP_LAMBDA = 0.90f;  // forgetting factor of the group fit
+static constexpr float   ETA_ERR_ALPHA    = 0.20f;  // EMA weight of a new error sample
+static constexpr uint8_t ETA_SAVE_EVERY   = 5;      // pours between NVS writes (flash wear)
+
+// Predicted seconds from the "eta" status to the pour result, given the
+// planner's summed makespan and the number of priority groups. lightClean =
+// post-pour clean is the air purge only (clean_policy.h).
+float etaModelPredict(float plannedDispenseSec, uint8_t groups, bool lightClean = false);
+
+// Share of the learned clean phase taken by the top air purge alone.
+static constexpr float ETA_LIGHT_CLEAN_SHARE = (float)CLEAN_AIR_TOP_MS / (float)(CLEAN_WATER_MS + CLEAN_AIR_TOP_MS);
+
+// Expected seconds of one phase / one priority group (planner makespan corrected).
+float etaModelPhaseSec(EtaPhase phase);
+float etaModelGroupSec(float plannedSec);
+
+// Samples from a finished pour (seconds). Group time excludes cup-removal pauses.
+void etaModelRecordPhase(EtaPhase phase, float sec);
+void etaModelRecordGroup(float plannedSec, float measuredSec);
+
+// Close out a pour: updates the error statistics and saves every ETA_SAVE_EVERY pours.
+void etaModelRecordPour(float predictedSec, float actualSec);
+
+// Learned parameters + error statistics, for GET_ETA_MODEL.
+void etaModelToJson(JsonObject out);
+
+// Forget everything learned (RAM and NVS).
+void etaModelReset();
+
+#endif // ETA_MODEL_H
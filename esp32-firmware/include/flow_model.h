@@ -0,0 +1,81 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: flow_model.h
+ *  Description: RAM-resident flow model used by the pour planner. Per-valve
+ *               flow (oz/s) is a 2D table keyed by slot and number of open
+ *               valves, built from the pump calibration (rates_lps / fit), a
+ *               per-slot line multiplier and a viscosity class derived from
+ *               the ingredient's `type` in ingredients.json. The table is
+ *               rebuilt only when the calibration version changes, so the
+ *               pour hot path is a single array read (times the slot's
+ *               fill-level factor, refreshed once per priority group from
+ *               the tracked bottle volume).
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef FLOW_MODEL_H
+#define FLOW_MODEL_H
+
+#include <Arduino.h>
+#include "drink_controller.h"   // IngredientCommand
+#include "board_profile.h"      // BOARD_SPI_SLOTS
+
+// Viscosity classes follow the `type` field of ingredients.json
+enum ViscosityClass : uint8_t {
+    VISC_ALCOHOL = 0,   // spirits, liqueurs, wine
+    VISC_MIXER,         // sodas, waters
+    VISC_SOUR,          // citrus juices, sour mix
+    VISC_SWEET,         // syrups, cream, fruit juices, purees
+    VISC_CLASS_COUNT
+};
+
+static constexpr uint8_t FLOW_MAX_SLOT = BOARD_SPI_SLOTS;  // SPI slots 1..N incl. water/air
+static constexpr uint8_t FLOW_MAX_OPEN = 16;  // open-valve counts 1..16
+
+// Default viscosity multipliers (applied on top of the pump calibration)
+static constexpr float FLOW_VISC_DEFAULTS[VISC_CLASS_COUNT] = { 1.00f, 1.00f, 0.95f, 0.80f };
+// Typical density (g/mL) per class, used to turn a recipe's ounces into a
+// target mass for gravimetric pours
+static constexpr float FLOW_VISC_DENSITY[VISC_CLASS_COUNT]  = { 0.95f, 1.02f, 1.03f, 1.20f };
+
+// Head-pressure compensation: per-slot multiplier as a function of liters left
+// in the bottle, piecewise-linear between these breakpoints and clamped at the
+// ends. Curves are calibrated per slot; the default reflects a bottle losing
+// head as it empties.
+static constexpr uint8_t FILL_CURVE_POINTS = 4;
+static constexpr float   FILL_CURVE_L[FILL_CURVE_POINTS]       = { 0.05f, 0.25f, 0.50f, 1.00f };
+static constexpr float   FILL_CURVE_DEFAULT[FILL_CURVE_POINTS] = { 0.88f, 0.94f, 0.98f, 1.00f };
+
+// Rebuild the tables if the calibration version changed. Call before planning.
+void flowModelRefresh();
+
+// Set the fill-level factor of each slot in `group` from getVolumeLitersForSlot(),
+// evaluated at the middle of this pour (current volume minus half the amount).
+void flowModelUpdateFill(const IngredientCommand *group, size_t n);
+
+// Fill-level multiplier for a slot at `litersLeft` (curve lookup, no state change).
+float flowModelFillFactor(int slot, float litersLeft);
+
+// Total pump flow (oz/s) with numOpen valves open (legacy flowRate(n) curve).
+float flowModelTotalRate(int numOpen);
+
+// Per-valve flow (oz/s) for `slot` while numOpen valves share the pump.
+// Table read × fill factor – call flowModelRefresh()/flowModelUpdateFill() first.
+float flowModelSlotRate(int slot, int numOpen);
+
+// Regulated pour speed (% PWM duty) while numOpen valves are open: PUMP_SPEED_POUR
+// (the calibration speed), raised towards 100% while the spout flow stays under
+// POUR_SPLASH_OZS. Flow is taken as proportional to duty. Table read.
+uint8_t flowModelPumpPct(int numOpen);
+
+// Per-valve flow (oz/s) at the regulated pour speed – what the pour planner uses.
+float flowModelPourRate(int slot, int numOpen);
+
+// Expected grams per recipe ounce for `slot` (density of its class). Table read.
+float flowModelGramsPerOz(int slot);
+
+// Ingredient id (ingredients.json) → viscosity class.
+ViscosityClass viscosityClassForIngredient(uint16_t ingredientId);
+
+#endif // FLOW_MODEL_H
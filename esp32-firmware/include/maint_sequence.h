@@ -0,0 +1,79 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: maint_sequence.h
+ *  Description: Cleaning cycles as step tables. A step is a whole-machine
+ *               actuator state (actuator_state.h), how long to hold it and an
+ *               optional exit condition that ends it early. One executor runs
+ *               every table against absolute deadlines, so the apply time of a
+ *               step never stretches the cycle. The built-in tables match the
+ *               pin_config.h durations. Replacements can be sent over
+ *               MAINTENANCE_TOPIC (SET_SEQUENCE); they are validated against
+ *               ACT_INTERLOCKS and kept in NVS.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef MAINT_SEQUENCE_H
+#define MAINT_SEQUENCE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "actuator_state.h"
+
+enum MaintSeqId : uint8_t {
+    MSEQ_QUICK_CLEAN = 0,  // QUICK_CLEAN: water, air top, trash
+    MSEQ_FULL_CLEAN,       // CUSTOM_CLEAN stop, DEEP_CLEAN final flush
+    MSEQ_POUR_CLEAN,       // after a drink: water, air top (trash drain runs while idle)
+    MSEQ_COUNT
+};
+
+enum MaintExit : uint8_t {
+    MEXIT_NONE = 0,    // hold for ms
+    MEXIT_GRAMS,       // until the pad weighs arg g more than at step start (ms = timeout)
+    MEXIT_NO_CUP,      // until nothing is on pad A (ms = timeout)
+};
+
+struct MaintStep {
+    ActuatorMask mask;     // routes as station A; remapped per run (MaintRun)
+    uint32_t     ms;       // hold time, or the timeout of an exit condition
+    uint16_t     arg;      // exit argument (MEXIT_GRAMS: grams)
+    uint8_t      pumpPct;  // pump duty when ACT_PUMP is set; 0 = PUMP_SPEED_CLEAN
+    uint8_t      exit;     // MaintExit
+};
+
+static constexpr uint8_t  MSEQ_MAX_STEPS   = 12;
+static constexpr uint32_t MSEQ_MAX_STEP_MS = 60000;
+static constexpr uint32_t MSEQ_POLL_MS     = 20;    // exit-condition / tick period
+
+// Per-run options. Outlet sets equal to station A's pour / purge path are
+// replaced with spoutOuts / purgeOuts (dual-station pours clean both spouts).
+struct MaintRun {
+    uint8_t      spoutOuts = STATION_A_POUR_OUTS;
+    uint8_t      purgeOuts = STATION_A_PURGE_OUTS;
+    ActuatorMask skip      = 0;                 // steps using any of these bits are skipped
+    void       (*onStep)(const MaintStep &st) = nullptr;  // after each step is applied
+    void       (*tick)() = nullptr;             // every MSEQ_POLL_MS while a step holds
+    bool       (*cancelled)() = nullptr;        // checked before each step and every MSEQ_POLL_MS
+};
+
+// Runs the table and ends with every actuator off. False if a step was refused
+// or run.cancelled() returned true (within MSEQ_POLL_MS of it being set).
+bool mseqRun(MaintSeqId id, const MaintRun &run = MaintRun());
+
+// Planned length (timeouts count in full) of the steps not skipped.
+uint32_t mseqDurationMs(MaintSeqId id, ActuatorMask skip = 0);
+
+const char *mseqName(MaintSeqId id);
+
+// SET_SEQUENCE: { name, steps:[{ route:"spout|purge|trash|none" | outlets:N, water, air,
+// slots:[..], pump:true|false|pct, ms, until:"grams|no_cup", g }] }. Validated, stored
+// in NVS and used from the next run. Returns nullptr or the reason it was rejected.
+const char *mseqSetFromJson(JsonObjectConst cmd);
+
+// RESET_SEQUENCE: back to the built-in table (NVS entry removed).
+bool mseqReset(const char *name);
+
+// GET_SEQUENCES: { sequences:{ NAME:{ custom, ms, steps:[..] } } }
+void mseqToJson(JsonObject out);
+
+#endif // MAINT_SEQUENCE_H
@@ -9,14 +9,22 @@
 
 #include <Arduino.h>
 
+// Create the maintenance worker (static task + queue). Call once from setup().
+// Every blocking sequence below runs on it, one at a time; a second request
+// while one is queued or running is answered with error "busy".
+void initMaintenanceController();
+
+// preemptible: a drink order arriving while the task runs cancels it (the order
+// is queued and starts once the device is IDLE); otherwise orders are refused.
+
 // Start the READY_SYSTEM (prime tubes) maintenance task
-void startReadySystemTask();
+void startReadySystemTask(bool preemptible = false);
 
 // Start the EMPTY_SYSTEM maintenance task
-void startEmptySystemTask();
+void startEmptySystemTask(bool preemptible = false);
 
 // Quick clean: short automatic rinse to spout; publishes OK when finished
-void startQuickCleanTask();
+void startQuickCleanTask(bool preemptible = true);
 
 // Custom clean controls for a single ingredient line (1-based)
 // phase: 1 = soap/cleaner, 2 = rinse
@@ -40,4 +48,22 @@ void stopEmptyIngredientTask();
 void startCalibrationMode(int solenoids);
 void stopCalibrationMode();
 
+// Automatic flow calibration: runs 1..5 open valves into a container on the
+// weighing pad, fits linear/log models and saves with saveFlowCalibrationToNVS().
+// windowMs = 0 uses AUTO_CALIB_WINDOW_MS. STOP_CALIBRATION aborts it.
+void startAutoCalibration(uint32_t windowMs = 0);
+
+// CANCEL: the running sequence stops at its next step boundary or check (at most
+// MAINT_CANCEL_POLL_MS later) with every valve closed and the pump off, then
+// reports { status:"cancelled", action, reason } and returns to IDLE. An
+// open-ended mode (custom/deep clean line, single-ingredient empty, calibration)
+// is switched off at once. False if no maintenance was running.
+bool maintCancel();
+
+// True while the running sequence was started preemptible.
+bool maintPreemptible();
+
+// A drink order was queued: cancel the running sequence if it is preemptible.
+bool maintPreemptForOrder();
+
 #endif // MAINTENANCE_CONTROLLER_H
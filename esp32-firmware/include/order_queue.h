@@ -0,0 +1,49 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: order_queue.h
+ *  Description: On-device FIFO of drink orders accepted while the machine is
+ *               busy. Stock is reserved when an order is queued
+ *               (dcReserveStock), so queued orders cannot over-commit a
+ *               bottle. The head order starts from loop() as soon as the
+ *               device is IDLE again and a fresh cup is on the pad – no cloud
+ *               round trip between drinks. Main loop only (MQTT callback and
+ *               loop()), so there is no locking.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef ORDER_QUEUE_H
+#define ORDER_QUEUE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+enum OrderQueueStatus : uint8_t {
+    OQ_QUEUED = 0,
+    OQ_FULL,          // ORDER_QUEUE_CAP orders waiting
+    OQ_NO_STOCK,      // volumes minus reservations do not cover it
+    OQ_INVALID,       // no valid ingredient, > DRINK_MAX_ITEMS entries, or > ORDER_CMD_MAX
+};
+
+struct OrderTicket {
+    uint16_t id;          // echoed in "queued" / "order_start" / "order_dropped"
+    uint8_t  position;    // 1 = next to pour
+    float    startInSec;  // predicted seconds until it starts (cup placed promptly)
+};
+
+// Queue a drink command; reserves its stock on success.
+OrderQueueStatus orderQueuePush(const char *cmd, bool overrideNoCup, uint8_t progressHz,
+                                uint8_t count, OrderTicket &ticket);
+
+// Orders waiting (not counting the one pouring).
+uint8_t orderQueueLength();
+
+// Call from loop(): starts the head order once the device is IDLE and a cup has
+// been put down since the last pour (the finished drink must be lifted first),
+// and drops it after ORDER_QUEUE_CUP_WAIT_MS without one.
+void orderQueueService();
+
+// { orders:[{ order_id, position, count, start_in }] } for GET_QUEUE.
+void orderQueueToJson(JsonObject out);
+
+#endif // ORDER_QUEUE_H
@@ -22,11 +22,32 @@
 #define SPI_MISO        19
 #define SPI_SCK         18
 #define SPI_CS          5   // Chip Select for the (daisy‑chained) NCV7240 drivers
+#define NCV_SPI_HOST    SPI3_HOST   // VSPI – native pins above, DMA capable
+#define NCV_SPI_HZ      5000000     // NCV7240 maximum SCLK
 
+// Valve chain layout (board_profile.h), named by its SPI slot count:
+//   14 = 2 chips, 12 ingredients   24 = 3 chips, 22 ingredients   32 = 4 chips, 30 ingredients
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE   14          // or -DBOARD_PROFILE=24 / 32 in build_flags
+#endif
 
-/* ----------------------------- Pump (MOSFET) ----------------------------------- */
-// MOSFET gate control pin for pump
+
+/* ----------------------------- Pump (MOSFET, LEDC PWM) ------------------------ */
+// MOSFET gate control pin for pump, driven by an LEDC PWM channel
 #define PUMP_MOSFET_PIN 33
+#define PUMP_PWM_CHANNEL    0       // LEDC channel (low-speed group, timer 0)
+#define PUMP_PWM_FREQ_HZ    20000   // above the audible range
+#define PUMP_PWM_RES_BITS   10      // duty resolution
+#define PUMP_RAMP_MS        150     // soft-start: 0 → setpoint
+#define PUMP_SLEW_MS        40      // setpoint change while running
+#define PUMP_RAMP_STEP_MS   5       // ramp update period
+
+// Speed setpoints (% duty) per phase
+#define PUMP_SPEED_CLEAN    100     // flushes, purges, drains, maintenance
+#define PUMP_SPEED_POUR     85      // nominal pour speed – flow calibration is taken at this speed
+// Regulated pour speed: with few valves open the pump runs faster than nominal
+// (up to 100%) while the flow at the spout stays under this splash limit.
+#define POUR_SPLASH_OZS     0.68f   // oz/s
 
 /* ----------------------------- Optional NCV7240 control ------------------------ */
 // If your hardware exposes EN or LHI (latched fault) control lines, set real GPIOs.
@@ -35,26 +56,71 @@
 #define NCV_LHI_PIN     -1
 
 
-// No PWM/duty needed for MOSFET pump control
-
 /* ----------------------------- Cleaning Durations ------------------------------ */
-// Slot 13 = WATER flush, Slot 14 = AIR (trash/purge) per drink_controller logic
-#define CLEAN_WATER_MS     3500   // ms pump ON from water valve (SPI slot 13) open to output spout
+// Water flush and AIR (trash/purge) slots come from the board profile (13 / 14 on the standard PCB)
+#define CLEAN_WATER_MS     3500   // ms pump ON from water valve (water slot) open to output spout
 #define CLEAN_AIR_TOP_MS   2000   // ms pump ON to push air out of top/spout (outputs 1/4 path)
-#define CLEAN_TRASH_MS     3000   // ms pump ON + trash/air valve (SPI slot 14) open to dump
+#define CLEAN_TRASH_MS     3000   // ms pump ON + trash/air valve (air slot) open to dump
+
+// Adaptive cleaning (clean_policy.h): residue left in the line between repeat
+// drinks is rinsed to trash before the next pour once it is older than this.
+#define CLEAN_RESIDUE_MAX_MS  120000  // ms
+
+// Idle cleaning jobs (trash drain, stale-residue rinse) start once the device
+// has been IDLE this long, so an order right after a pour does not start/stop them.
+#define IDLE_CLEAN_GAP_MS     1000    // ms
+#define IDLE_CLEAN_POLL_MS    10      // ms between preemption checks while a job runs
+
+/* ----------------------------- Batch Pours ------------------------------------ */
+// Drink command "count": the same drink poured back to back on swapped cups.
+#define POUR_BATCH_MAX        20      // drinks per command
+#define BATCH_CUP_SWAP_MS     120000  // ms to lift the filled cup and place the next one
+
+/* ----------------------------- Order Queue ------------------------------------ */
+// Drink orders accepted while busy (order_queue.h); stock is reserved on entry.
+#define ORDER_QUEUE_CAP          8       // pending orders
+#define ORDER_CMD_MAX            160     // bytes per stored command string
+#define ORDER_QUEUE_CUP_WAIT_MS  120000  // ms the head order waits for a fresh cup
 
 /* ----------------------------- Quick Clean Duration -------------------------- */
-// Quick clean: water-only forward flush duration (outputs 1 & 3 path, slot 13 open, 1..12 closed, 14 closed)
+// Quick clean: water-only forward flush duration (outputs 1 & 3 path, water open, ingredients and air closed)
 #define QUICK_CLEAN_MS     5000   // ms (tune as needed)
 
 /* ----------------------------- Empty System Duration ------------------------- */
-// Time to run the backflow/empty routine (open slots 1..12, outputs 2&4 path, slots 13&14 open)
+// Time to run the backflow/empty routine (open all ingredient slots, outputs 2&4 path, water & air open)
 #define EMPTY_SYSTEM_MS     4000   // ms
 
+/* ----------------------------- Maintenance cancel ----------------------------- */
+// CANCEL (or a drink order preempting a preemptible routine) is checked at every
+// step boundary and this often while a step holds; all actuators are off right after.
+#define MAINT_CANCEL_POLL_MS  20      // ms
+
 /* ----------------------------- Deep Clean Duration --------------------------- */
-// Time to run deep clean (outputs 1&3 path, open 1..12 + water feed; pump forward)
+// Time to run deep clean (outputs 1&3 path, open all ingredient slots + water feed; pump forward)
 #define DEEP_CLEAN_MS        10000  // ms
 
+/* ----------------------------- Line priming (READY_SYSTEM) ------------------- */
+// Lines are primed several at a time (count picked from the flow model, next
+// line opens as one closes). Each stays open for its learned prime time
+// (prime_model.h); with a container on the weighing pad it closes once its
+// liquid is seen at the spout, and the time it took is learned.
+#define PRIME_MAX_OPEN        6       // lines open together at most
+#define PRIME_DEFAULT_MS      1300    // ms, one line open, until a time is learned
+#define PRIME_MAX_MS          8000    // ms, learned times are capped here
+#define PRIME_ARRIVE_G        3.0f    // g above the expected mass = the next line reached the spout
+#define PRIME_TAIL_MS         150     // ms a line stays open after its liquid arrived
+#define PRIME_TIMEOUT_PCT     150     // % of the expected time before an unseen line is closed
+#define PRIME_GROW_PCT        125     // % an unseen line's learned time may grow per run at most
+#define PRIME_POLL_MS         20      // ms between weight checks
+
+/* ----------------------------- Auto flow calibration ------------------------- */
+// AUTO_CALIBRATE runs 1..5 open valves into a container on the weighing pad.
+// Per configuration: pump settles, then mass is measured over the window.
+// Five runs pour roughly 5 × window × 0.5 oz/s – use a pitcher, not a glass.
+#define AUTO_CALIB_SETTLE_MS   800    // ms after valves open before measuring
+#define AUTO_CALIB_WINDOW_MS   3000   // ms measurement window per configuration
+#define AUTO_CALIB_GAP_MS      300    // ms pump off between configurations
+
 /* ----------------------------- Outlet/Top Solenoids (GPIO) --------------------- */
 // Four additional non-SPI solenoids near the outlet controlled directly via GPIO.
 // Index → GPIO mapping:
@@ -65,6 +131,25 @@
 #define OUT_SOL3_PIN     27
 #define OUT_SOL4_PIN     14
 
+/* ----------------------------- Pour stations ----------------------------------- */
+// Spouts with their own outlet path and cup pad, fed by the one pump and manifold
+// (pour_resources.h). 1 = standard build. 2 = dual-station variant: a queued order
+// waits with its cup on station B and pours right after the order on station A.
+#ifndef POUR_STATIONS
+#define POUR_STATIONS    1            // or -DPOUR_STATIONS=2 in build_flags
+#endif
+// Outlet paths as bit masks over OUT_SOL1..6 (bit 0 = OUT_SOL1)
+#define STATION_A_POUR_OUTS   0x05   // OUT1 + OUT3 → spout A
+#define STATION_A_PURGE_OUTS  0x09   // OUT1 + OUT4 → air out of the top of spout A
+#define TRASH_OUTS            0x0A   // OUT2 + OUT4 → backflow to trash (shared)
+#if POUR_STATIONS > 1
+#define OUT_SOL5_PIN     16
+#define OUT_SOL6_PIN     17
+#define STATION_B_POUR_OUTS   0x30   // OUT5 + OUT6 → spout B
+#define STATION_B_PURGE_OUTS  0x18   // OUT5 + OUT4 (the top vent is shared with A and trash)
+#define PRESSURE_ADC_PIN_B    35     // ADC1 – station B cup pad
+#endif
+
 /* ----------------------------- LED (status) ------------------------------------ */
 #define LED_PIN          4   // NeoPixel data pin (24 LED ring)
 
@@ -82,4 +167,25 @@
 #define PRESSURE_OFF_PCT     0.02f  // 2% to clear (keeps ~40% hysteresis band)
 #define PRESSURE_DEBOUNCE_MS 120
 
+/* ----------------------------- Gravimetric pours ----------------------------- */
+// When the pad has a weight curve (pressure_pad.h), pours are closed-loop on
+// measured mass: the valve timeline is re-timed to where the scale says the
+// pour is. Bounds keep a bad reading (bumped cup, hand on pad) from running away.
+#define GRAV_LAG_MS          120    // EMA filter + free-fall delay between valve and pad reading
+#define GRAV_MIN_GRAMS       4.0f   // ignore corrections until this much mass has landed
+#define GRAV_RATE_MIN        0.60f  // plan time may run no slower than 60% of wall time...
+#define GRAV_RATE_MAX        1.50f  // ...and no faster than 150%
+
+/* ----------------------------- Launch latency -------------------------------- */
+// Budget from MQTT receive of a drink command to pump on (cup wait excluded).
+// The pour reports each stage in a {status:"started"} message and logs a
+// warning when the budget is exceeded.
+#define LAUNCH_BUDGET_MS     100
+
+/* ----------------------------- Pour progress --------------------------------- */
+// Progress frames ({status:"progress"}) between "eta" and the pour result.
+// Coalesced: only the latest frame is kept and the main loop publishes it.
+#define PROGRESS_HZ_DEFAULT  4      // frames per second (drink JSON `progress_hz` overrides)
+#define PROGRESS_HZ_MAX      10     // 0 disables frames
+
 #endif // PIN_CONFIG_H
@@ -0,0 +1,63 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: pour_planner.h
+ *  Description: Event-timeline planner for one priority group. Works out the
+ *               exact open/close instant of every valve from the flow model
+ *               before the pour starts, so drink_controller can fire the valve
+ *               changes from a hardware timer instead of integrating flow in
+ *               fixed scheduler ticks.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef POUR_PLANNER_H
+#define POUR_PLANNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "drink_command.h"   // IngredientCommand
+
+// Capacity: one open + one close per SPI slot.
+static constexpr uint8_t PLAN_MAX_SLOTS  = 16;
+static constexpr uint8_t PLAN_MAX_EVENTS = 2 * PLAN_MAX_SLOTS;
+
+struct ValveEvent {
+    uint32_t atUs;   // offset from group start (pump-on time only, pauses excluded)
+    uint8_t  slot;   // SPI slot 1..16
+    bool     open;   // true = open, false = close
+};
+
+struct PourPlan {
+    ValveEvent events[PLAN_MAX_EVENTS]; // sorted by atUs
+    uint8_t    count;
+    uint32_t   makespanUs;              // time of the last close
+    uint8_t    maxOpen;                 // concurrency cap the plan was built with
+};
+
+// Per-valve flow (oz/s) delivered to `slot` while `numOpen` valves share the pump.
+typedef float (*SlotFlowFn)(int slot, int numOpen);
+
+// Build the timeline for a group with at most `maxOpen` valves open at once
+// (0 = no cap). Valves start largest-amount first; whenever one closes the
+// next waiting valve opens in the same instant. Entries with amount <= 0 are
+// skipped. Returns false if the group does not fit in a PourPlan or the flow
+// model reports no flow for an open valve.
+bool planParallelGroup(const IngredientCommand *group, size_t n, SlotFlowFn flow, PourPlan &plan,
+                       uint8_t maxOpen = 0);
+
+// Pick the concurrency cap that minimises the group makespan under the
+// calibrated curve. A larger cap is only taken when it shortens the group by
+// more than PLAN_CAP_GAIN, so valves that no longer add flow stay closed.
+static constexpr float PLAN_CAP_GAIN = 0.02f;
+bool planGroupMinMakespan(const IngredientCommand *group, size_t n, SlotFlowFn flow, PourPlan &plan);
+
+// Expected cumulative poured mass (g) at each event of `plan`, for closed-loop
+// (gravimetric) pours. gramsPerOz converts a slot's ounces to grams.
+typedef float (*SlotGramsFn)(int slot);
+void planMassProfile(const PourPlan &plan, SlotFlowFn flow, SlotGramsFn gramsPerOz, float *gramsAtEvent);
+
+// Inverse of the mass profile: plan time (us) at which `grams` is expected.
+// Clamped to [0, makespan].
+uint32_t planTimeForMass(const PourPlan &plan, const float *gramsAtEvent, float grams);
+
+#endif // POUR_PLANNER_H
@@ -0,0 +1,26 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: pour_resources.h
+ *  Description: What a pour holds: its ingredient lines, the pump, the manifold
+ *               every line feeds, the OUT4 top vent (used by both stations' air
+ *               purge and the trash path) and one station – the station's spout
+ *               path and cup pad. The pump, manifold and vent are single on this
+ *               machine, so a pour owns them alone; on dual-station builds the
+ *               order queue runs a paired order on station B right after station
+ *               A's. This module maps a station to its outlet routes.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef POUR_RESOURCES_H
+#define POUR_RESOURCES_H
+
+#include <Arduino.h>
+#include "pin_config.h"         // POUR_STATIONS, STATION_*_OUTS
+
+// Outlet masks (bit 0 = OUT_SOL1) for the pour path and the top air purge of a
+// station (0 = A, 1 = B). 0 if the station does not exist.
+uint8_t prPourOutlets(uint8_t station);
+uint8_t prPurgeOutlets(uint8_t station);
+
+#endif // POUR_RESOURCES_H
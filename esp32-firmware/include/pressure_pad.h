@@ -34,7 +34,8 @@ void pressurePadInit();
 void pressurePadCalibrate(uint16_t durationMs = 1500);
 
 // Presence detection API (uses hysteresis around threshold percent)
-bool isCupPresent();
+bool isCupPresent();                  // station A (the only pad on standard builds)
+bool isCupPresentAt(uint8_t station); // 0 = A, 1 = B (POUR_STATIONS > 1); false if absent
 void setPresenceThresholdPercent(float pctOn /*0..1*/);
 void setPresenceHysteresisPercent(float pctOff /*0..1*/); // off threshold relative to baseline
 void setPresenceDebounceMs(uint16_t ms);
@@ -59,4 +60,17 @@ float    pressurePadFiltered();   // EMA filtered reading
 float    pressurePadBaseline();   // current baseline (slowly tracks when no cup)
 float    pressurePadPctOver();    // One-sided delta in the configured cup-press direction, >= 0
 
+// ---------------- Weight estimation (gravimetric mode) ----------------
+// A per-device curve maps counts over the tare point (in the cup-press
+// direction) to grams, piecewise-linear and extrapolated from the last
+// segment. Stored in NVS namespace "padcal"; loaded by pressurePadInit().
+#define PAD_WEIGHT_MAX_POINTS 6
+
+void     pressurePadTare();                  // zero the weight at the current filtered reading
+float    pressurePadGrams();                 // grams since the last tare (0 if no curve)
+float    pressurePadCountsOverTare();        // raw counts since tare, presence direction, >= 0
+bool     pressurePadWeightReady();           // curve loaded and gravimetric mode enabled
+bool     setPadWeightCurve(const float *counts, const float *grams, uint8_t n, bool enabled); // persists
+uint8_t  getPadWeightCurve(float *counts, float *grams, uint8_t maxN, bool &enabled);
+
 #endif // PRESSURE_PAD_H
@@ -0,0 +1,52 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: prime_model.h
+ *  Description: Learned prime time per ingredient line: how long liquid takes
+ *               from the bottle to the spout with one line open (tube length).
+ *               With k lines open each gets flowModelSlotRate(slot, k) instead
+ *               of the single-line rate, so its time scales by the ratio. The
+ *               same scaling picks how many lines READY_SYSTEM primes at once.
+ *               Refined from the weighing pad, kept in RAM and saved to NVS
+ *               after each priming run that learned something.
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef PRIME_MODEL_H
+#define PRIME_MODEL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+static constexpr float PRIME_ALPHA = 0.5f;   // EMA weight of a new sample
+
+// Expected ms from valve open to liquid at the spout for `slot` (1-based
+// ingredient line) while numOpen lines share the pump.
+uint32_t primeModelMs(uint8_t slot, uint8_t numOpen);
+
+// Plan for priming lines 1..n: fills order[0..n-1] longest first and returns
+// how many lines to keep open at once (shortest estimated makespan, written to
+// makespanMs). Refreshes the flow model under dcPlanLock(), so it is safe from
+// the MQTT loop (GET_PRIME_MODEL) while a pour or estimate plans.
+uint8_t primeModelPlan(uint8_t n, uint8_t *order, uint32_t &makespanMs);
+
+// Measured time from valve open to liquid at the spout; numOpen is the mean
+// number of lines open meanwhile (time-weighted, may be fractional).
+// Normalised to one open line; each sample moves the estimate by at most ×2.
+void primeModelRecord(uint8_t slot, float numOpen, uint32_t ms);
+
+// The line was open ms without reaching the spout: the true time is at least
+// that. Only raises the estimate, by at most PRIME_GROW_PCT per call, and does
+// not count as a sample.
+void primeModelRecordAtLeast(uint8_t slot, float numOpen, uint32_t ms);
+
+// Write to NVS if anything was learned since the last save.
+void primeModelSave();
+
+// Per-line times and sample counts + the current plan, for GET_PRIME_MODEL.
+void primeModelToJson(JsonObject out);
+
+// Forget everything learned (RAM and NVS).
+void primeModelReset();
+
+#endif // PRIME_MODEL_H
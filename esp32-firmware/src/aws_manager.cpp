@@ -7,6 +7,7 @@
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <Preferences.h>
+#include <esp_timer.h>
 #include "aws_manager.h"     // LIQUORBOT_ID & topic macros
 #include "certs.h"
 #include "drink_controller.h"
@@ -15,6 +16,13 @@
 #include "bluetooth_setup.h"
 #include "maintenance_controller.h"
 #include "pressure_pad.h"
+#include "flow_model.h"
+#include "eta_model.h"
+#include "order_queue.h"
+#include "maint_sequence.h"
+#include "prime_model.h"
+#include "pin_config.h"
+#include "board_profile.h"   // BOARD_SPI_SLOTS, BOARD_INGREDIENT_SLOTS
 
 #define FLOW_CALIB_TOPIC  "liquorbot/liquorbot" LIQUORBOT_ID "/calibrate/flow"
 // Flow calibration (max 5 rates, linear/log fit)
@@ -26,18 +34,25 @@ static float flowFitA = 0, flowFitB = 0;
 static Preferences prefs;       // slotconfig + volumes (kept open during runtime)
 static Preferences flowPrefs;   // flowcalib (opened per op to avoid namespace conflicts)
 
+// Inbound/outbound MQTT packet size (PubSubClient defaults to 256 bytes, too
+// small for ESTIMATE menus and calibration replies)
+#define MQTT_BUFFER_SIZE      4096
+#define ESTIMATE_MAX_RECIPES  48
+
 // Calibration change counter for hot-reload in drink_controller
 static volatile uint32_t g_flowCalibVersion = 0;
 uint32_t getCalibrationVersion() { return g_flowCalibVersion; }
 
-/* Up to 15 slots (adjust if needed) */
-static uint16_t slotConfig[15] = {0};
-static float    slotVolumes[15] = {0}; // volume per slot, stored in liters (L)
+/* One entry per SPI slot of the board profile (+1 spare, keeps the NVS key set) */
+static constexpr uint8_t SLOT_TABLE_LEN = BOARD_SPI_SLOTS + 1;
+static uint16_t slotConfig[SLOT_TABLE_LEN] = {0};
+static float    slotVolumes[SLOT_TABLE_LEN] = {0}; // volume per slot, stored in liters (L)
 
-// Get slot count from first two digits of LIQUORBOT_ID
+// Get slot count from first two digits of LIQUORBOT_ID (never more than the board has)
 
 static uint8_t getSlotCount() {
-    return (LIQUORBOT_ID[0] - '0') * 10 + (LIQUORBOT_ID[1] - '0');
+    uint8_t n = (LIQUORBOT_ID[0] - '0') * 10 + (LIQUORBOT_ID[1] - '0');
+    return n > BOARD_INGREDIENT_SLOTS ? BOARD_INGREDIENT_SLOTS : n;
 }
 
 void saveFlowCalibrationToNVS(const float *ratesLps, int count, const char *fitType, float a, float b) {
@@ -55,6 +70,59 @@ void saveFlowCalibrationToNVS(const float *ratesLps, int count, const char *fitT
     g_flowCalibVersion++;
 }
 
+void saveFlowScalesToNVS(const float *slotScale, int slotCount, const float *viscScale, int viscCount) {
+    flowPrefs.begin("flowcalib", false);
+    for (int i = 0; i < slotCount && slotScale; ++i) {
+        char key[8]; snprintf(key, sizeof(key), "s%d", i);
+        flowPrefs.putFloat(key, slotScale[i]);
+    }
+    for (int i = 0; i < viscCount && viscScale; ++i) {
+        char key[8]; snprintf(key, sizeof(key), "v%d", i);
+        flowPrefs.putFloat(key, viscScale[i]);
+    }
+    flowPrefs.end();
+    g_flowCalibVersion++;
+}
+
+void loadFlowScalesFromNVS(float *slotScale, int slotCount, float *viscScale, int viscCount) {
+    bool ok = flowPrefs.begin("flowcalib", true);
+    for (int i = 0; i < slotCount; ++i) {
+        char key[8]; snprintf(key, sizeof(key), "s%d", i);
+        float v = ok ? flowPrefs.getFloat(key, 1.0f) : 1.0f;
+        slotScale[i] = (v > 0.0f) ? v : 1.0f;
+    }
+    for (int i = 0; i < viscCount; ++i) {
+        char key[8]; snprintf(key, sizeof(key), "v%d", i);
+        float def = (i < VISC_CLASS_COUNT) ? FLOW_VISC_DEFAULTS[i] : 1.0f;
+        float v = ok ? flowPrefs.getFloat(key, def) : def;
+        viscScale[i] = (v > 0.0f) ? v : def;
+    }
+    if (ok) flowPrefs.end();
+}
+
+void saveFillCurveToNVS(int slotZeroBased, const float *scale, int points) {
+    flowPrefs.begin("flowcalib", false);
+    for (int p = 0; p < points && p < FILL_CURVE_POINTS; ++p) {
+        char key[8]; snprintf(key, sizeof(key), "f%d_%d", slotZeroBased, p);
+        flowPrefs.putFloat(key, scale[p]);
+    }
+    flowPrefs.end();
+    g_flowCalibVersion++;
+}
+
+void loadFillCurvesFromNVS(float *curves, int slotCount, int points) {
+    bool ok = flowPrefs.begin("flowcalib", true);
+    for (int s = 0; s < slotCount; ++s) {
+        for (int p = 0; p < points; ++p) {
+            char key[8]; snprintf(key, sizeof(key), "f%d_%d", s, p);
+            float def = (p < FILL_CURVE_POINTS) ? FILL_CURVE_DEFAULT[p] : 1.0f;
+            float v = ok ? flowPrefs.getFloat(key, def) : def;
+            curves[s * points + p] = (v > 0.0f) ? v : def;
+        }
+    }
+    if (ok) flowPrefs.end();
+}
+
 bool loadFlowCalibrationFromNVS(float *ratesLps, int &count, char *fitType, float &a, float &b) {
     bool ok = flowPrefs.begin("flowcalib", true);
     if (!ok) {
@@ -100,8 +168,27 @@ WiFiClientSecure secureClient;
 PubSubClient     mqttClient(secureClient);
 
 /* ---------- pour‑result hand‑off (from FreeRTOS task → main loop) ---------- */
-static volatile bool   pourResultPending = false;
-static String          pourResultMessage;
+// One mailbox per station, so station A's result is not overwritten by B's pour.
+// Fixed buffers: the pour task formats the result without touching the heap.
+static bool            pourResultPending[2] = { false, false };
+static char            pourResultMessage[2][128];
+static portMUX_TYPE    pourResultMux = portMUX_INITIALIZER_UNLOCKED;
+
+// ---------- deferred publishes from tasks (fixed slots, no heap) ----------
+// One slot stays empty, so DEFER_CAP - 1 fit. Worst burst before the loop
+// drains: order_start/order_next/order_dropped, eta, started, the next drink's
+// eta, no-glass and a valve fault – with room to spare across a reconnect.
+struct DeferredMsg { const char *topic; char body[256]; };
+static constexpr uint8_t DEFER_CAP = 8;
+static DeferredMsg     deferQ[DEFER_CAP];
+static uint8_t         deferHead = 0, deferTail = 0;
+static uint16_t        deferDropped = 0;   // since last logged
+static portMUX_TYPE    deferMux = portMUX_INITIALIZER_UNLOCKED;
+
+// ---------- pour progress hand-off (latest frame wins) ----------
+static portMUX_TYPE    progressMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool   progressPending = false;
+static PourProgress    progressFrame;
 
 // ---------- volume config hand-off (non-blocking) ----------
 static volatile bool   volumeConfigPending = false;
@@ -147,6 +234,8 @@ void notifyVolumeUpdate(uint8_t slot, float volume) {
 
 /* ---------- forward decls ---------- */
 static void handleSlotConfigMessage(const String &json);
+static void handleEstimateRequest(JsonDocument &doc, const char *replyTopic);
+static void handleDrinkCommand(const char *payload, unsigned int length);
 static void loadSlotConfigFromNVS();
 static void saveSlotConfigToNVS();
 
@@ -163,6 +252,7 @@ void setupAWS() {
 
     mqttClient.setServer(AWS_IOT_ENDPOINT, 8883);
     mqttClient.setCallback(receiveData);
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
 }
 
 /* Keep the connection alive and process inbound packets */
@@ -191,10 +281,46 @@ void processAWSMessages() {
 
     mqttClient.loop();      // process packets
 
+    /* ---------- deferred task publishes (eta, launch latency) ---------- */
+    portENTER_CRITICAL(&deferMux);
+    uint16_t dropped = deferDropped;
+    deferDropped = 0;
+    portEXIT_CRITICAL(&deferMux);
+    if (dropped) Serial.printf("⚠️ [AWS] %u deferred publish(es) dropped (queue full or too long)\n", (unsigned)dropped);
+    while (true) {
+        DeferredMsg m;
+        portENTER_CRITICAL(&deferMux);
+        bool have = deferHead != deferTail;
+        if (have) { m = deferQ[deferTail]; deferTail = (uint8_t)(deferTail + 1) % DEFER_CAP; }
+        portEXIT_CRITICAL(&deferMux);
+        if (!have) break;
+        sendData(m.topic, m.body);
+    }
+    /* ---------- coalesced pour progress (before the result, so order holds) ---------- */
+    if (progressPending) {
+        portENTER_CRITICAL(&progressMux);
+        PourProgress p = progressFrame;
+        progressPending = false;
+        portEXIT_CRITICAL(&progressMux);
+        JsonDocument doc;
+        doc["status"]  = "progress";
+        doc["percent"] = p.percent;
+        doc["phase"]   = p.phase;
+        if (p.group) { doc["group"] = p.group; doc["groups"] = p.groups; }
+        doc["eta"]     = roundf(p.secondsLeft * 10.0f) / 10.0f; // seconds left
+        if (p.paused) doc["paused"] = true;
+        String out; serializeJson(doc, out);
+        sendData(AWS_RECEIVE_TOPIC, out);
+    }
     /* ---------- deferred pour-result publish ---------- */
-    if (pourResultPending) {
-        sendData(AWS_RECEIVE_TOPIC, pourResultMessage);
-        pourResultPending = false;
+    for (uint8_t leg = 0; leg < 2; ++leg) {
+        char msg[sizeof(pourResultMessage[0])];
+        portENTER_CRITICAL(&pourResultMux);
+        bool pending = pourResultPending[leg];
+        if (pending) memcpy(msg, pourResultMessage[leg], sizeof(msg));
+        pourResultPending[leg] = false;
+        portEXIT_CRITICAL(&pourResultMux);
+        if (pending) sendData(AWS_RECEIVE_TOPIC, msg);
     }
     /* ---------- deferred volume-config publish ---------- */
     if (volumeConfigPending) {
@@ -215,10 +341,192 @@ void processAWSMessages() {
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                    DRINK COMMAND (no heap until the pour)                  */
+/* -------------------------------------------------------------------------- */
+// Bump allocator over a fixed arena for the command's JsonDocument, rewound per
+// message: one ArduinoJson pool plus the command string and keys fit with room
+// to spare. Only the MQTT callback (main loop) uses it.
+class CommandArena : public ArduinoJson::Allocator {
+public:
+    void reset() { used_ = last_ = 0; }
+    void *allocate(size_t n) override {
+        size_t need = HDR + round8(n);
+        if (need > sizeof(buf_) - used_) return nullptr;
+        last_ = used_;
+        used_ += need;
+        *(size_t *)(buf_ + last_) = round8(n);   // block size, for reallocate
+        return buf_ + last_ + HDR;
+    }
+    void deallocate(void *) override {}
+    void *reallocate(void *p, size_t n) override {
+        if (!p) return allocate(n);
+        size_t at = (uint8_t *)p - buf_ - HDR;
+        size_t &size = *(size_t *)(buf_ + at);
+        if (at == last_) {                      // newest block: resize in place
+            if (HDR + round8(n) > sizeof(buf_) - at) return nullptr;
+            size = round8(n);
+            used_ = at + HDR + size;
+            return p;
+        }
+        if (round8(n) <= size) return p;        // older block: shrink in place
+        void *q = allocate(n);
+        if (q) memcpy(q, p, size);
+        return q;
+    }
+private:
+    static constexpr size_t HDR = 8;
+    static size_t round8(size_t n) { return (n + 7) & ~(size_t)7; }
+    alignas(8) uint8_t buf_[3072];
+    size_t used_ = 0, last_ = 0;
+};
+static CommandArena commandArena;
+
+// Requests other than a pour that share the drink topic; true if handled
+static bool handleDrinkTopicAction(JsonDocument &doc) {
+    const char *action = doc["action"] | "";
+    if (!strcmp(action, "ESTIMATE")) {
+        // Menu ETAs never touch hardware, so they are answered even while busy
+        handleEstimateRequest(doc, AWS_RECEIVE_TOPIC);
+        return true;
+    }
+    if (!strcmp(action, "GET_QUEUE")) {
+        JsonDocument resp;
+        JsonObject root = resp.to<JsonObject>();
+        orderQueueToJson(root);
+        root["action"]  = "QUEUE";
+        root["pouring"] = getCurrentState() == State::POURING;
+        String out; serializeJson(resp, out);
+        sendData(AWS_RECEIVE_TOPIC, out);
+        return true;
+    }
+    return false;
+}
+
+// Accept either a raw string or JSON object { command: string, override?: bool,
+// progress_hz?, count? }. The command is copied into a fixed ORDER_CMD_MAX
+// buffer and every reply on the way to startPourTask is formatted in place.
+static void handleDrinkCommand(const char *payload, unsigned int length) {
+    int64_t rxUs = esp_timer_get_time(); // start of the command→pump-on budget
+    char cmd[ORDER_CMD_MAX] = "";
+    bool overrideNoCup = false; uint8_t progressHz = PROGRESS_HZ_DEFAULT; int count = 1;
+    bool tooLong = false;
+    auto take = [&](const char *src, size_t len) {
+        // Stored and poured from fixed ORDER_CMD_MAX copies – never cut one short
+        if (len >= sizeof(cmd)) { tooLong = true; return; }
+        memcpy(cmd, src, len);
+        cmd[len] = '\0';
+    };
+    commandArena.reset();
+    JsonDocument jdoc(&commandArena);
+    DeserializationError err = deserializeJson(jdoc, payload, length);
+    if (err == DeserializationError::Ok) {
+        if (jdoc.is<JsonObject>()) {
+            if (handleDrinkTopicAction(jdoc)) return;
+            const char *c = jdoc["command"] | "";
+            overrideNoCup = jdoc["override"] | false;
+            progressHz    = jdoc["progress_hz"] | PROGRESS_HZ_DEFAULT;
+            count         = jdoc["count"] | 1;
+            if (!*c) c = jdoc.as<const char*>();   // also accept if message was a JSON string literal
+            if (c) take(c, strlen(c));
+        } else {
+            const char *c = jdoc.as<const char*>();
+            if (c) take(c, strlen(c));
+        }
+    } else if (err == DeserializationError::NoMemory) {
+        // Bigger than any pour: an ESTIMATE menu, parsed on the heap like before
+        JsonDocument big;
+        if (deserializeJson(big, payload, length) == DeserializationError::Ok &&
+            big.is<JsonObject>() && handleDrinkTopicAction(big)) return;
+        tooLong = true;
+    } else {
+        size_t len = length;
+        if (len >= 2 && payload[0] == '"' && payload[len - 1] == '"') { ++payload; len -= 2; }
+        take(payload, len);
+    }
+
+    if (tooLong) {
+        sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Command too long\"}");
+        Serial.printf("✖ Pour rejected – command longer than %u bytes\n", (unsigned)(ORDER_CMD_MAX - 1));
+        return;
+    }
+    Serial.printf("[AWS] Drink command received: %s\n", cmd);
+    // Batch: every drink after the first starts on a cup swap seen by the pad
+    if (count < 1 || count > POUR_BATCH_MAX || (count > 1 && overrideNoCup)) {
+        sendData(AWS_RECEIVE_TOPIC, overrideNoCup
+                 ? "{\"status\":\"fail\",\"error\":\"Batch pours need the pressure pad (no override)\"}"
+                 : "{\"status\":\"fail\",\"error\":\"Invalid count\"}");
+        Serial.printf("✖ Pour rejected – count %d\n", count);
+        return;
+    }
+
+    // Busy pouring (or others already waiting), or running a maintenance
+    // sequence an order may cancel → join the on-device queue
+    const bool preempt = getCurrentState() == State::MAINTENANCE && maintPreemptible();
+    if (getCurrentState() == State::POURING || (isIdle() && orderQueueLength()) || preempt) {
+        OrderTicket t;
+        OrderQueueStatus q = orderQueuePush(cmd, overrideNoCup, progressHz, (uint8_t)count, t);
+        char msg[112];
+        if (q == OQ_QUEUED) {
+            if (preempt) maintPreemptForOrder();   // safe state, IDLE, then the queue starts it
+            snprintf(msg, sizeof(msg), "{\"status\":\"queued\",\"order_id\":%u,\"position\":%u,\"start_in\":%.1f}",
+                     (unsigned)t.id, (unsigned)t.position, t.startInSec);
+        } else {
+            snprintf(msg, sizeof(msg), "{\"status\":\"fail\",\"error\":\"%s\"}",
+                     q == OQ_FULL     ? "Queue Full"
+                   : q == OQ_NO_STOCK ? "Insufficient ingredients"
+                                      : "Invalid command");
+        }
+        sendData(AWS_RECEIVE_TOPIC, msg);
+        return;
+    }
+
+    if (getCurrentState() != State::IDLE) {
+        /* Distinguish *why* we're busy. */
+        switch (getCurrentState()) {
+        case State::POURING:     sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Device Already In Use\"}");      break;
+        case State::MAINTENANCE: sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Device In Maintenance Mode\"}"); break;
+        default:                 sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Device Busy\"}");                break;
+        }
+        Serial.printf("✖ Busy – drink rejected. Current state: %d\n", (int)getCurrentState());
+        return;
+    }
+
+    // Require cup present BEFORE starting pour unless override flag is set
+    if (!overrideNoCup && !isCupPresent()) {
+        sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"No Glass Detected - place glass to start\"}");
+        Serial.println("✖ Pour rejected – no glass detected.");
+        return; // do not change state or start the pour task
+    }
+    // Hold the stock before starting so queued orders cannot claim it too
+    int held = dcReserveStock(cmd, (uint8_t)count);
+    if (held < 0) {
+        // No valid ingredient, or more entries than DRINK_MAX_ITEMS
+        sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Invalid command\"}");
+        Serial.println("✖ Pour rejected – invalid command.");
+        return;
+    }
+    if (held == 0) {
+        sendData(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Insufficient ingredients\"}");
+        notifyPourResult(false, "insufficient_ingredients");
+        Serial.println("✖ Pour rejected – insufficient ingredients.");
+        return;
+    }
+    setState(State::POURING);
+    Serial.println("→ State set to POURING");
+    /* Kick off non-blocking FreeRTOS task with the command and override flag */
+    startPourTask(cmd, overrideNoCup, progressHz, rxUs, (uint8_t)count);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                       MQTT MESSAGE HANDLER (callback)                      */
 /* -------------------------------------------------------------------------- */
 void receiveData(char *topic, byte *payload, unsigned int length) {
+    // 2 · Drink command – first, before any String is built
+    if (!strcmp(topic, AWS_PUBLISH_TOPIC)) {
+        handleDrinkCommand((const char *)payload, length);
+        return;
+    }
     String message  = String((char *)payload).substring(0, length);
     String topicStr = String(topic);
     // 0 · Flow calibration & RPC
@@ -239,6 +547,24 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
                 fit["type"] = ftype;
                 fit["a"] = A;
                 fit["b"] = B;
+                float ss[FLOW_MAX_SLOT]; float vs[VISC_CLASS_COUNT];
+                loadFlowScalesFromNVS(ss, FLOW_MAX_SLOT, vs, VISC_CLASS_COUNT);
+                JsonArray sarr = resp.createNestedArray("slot_scale");
+                for (int i = 0; i < getSlotCount() && i < FLOW_MAX_SLOT; i++) sarr.add(ss[i]);
+                JsonObject visc = resp.createNestedObject("viscosity");
+                visc["alcohol"] = vs[VISC_ALCOHOL];
+                visc["mixer"]   = vs[VISC_MIXER];
+                visc["sour"]    = vs[VISC_SOUR];
+                visc["sweet"]   = vs[VISC_SWEET];
+                float fc[FLOW_MAX_SLOT * FILL_CURVE_POINTS];
+                loadFillCurvesFromNVS(fc, FLOW_MAX_SLOT, FILL_CURVE_POINTS);
+                JsonArray fl = resp.createNestedArray("fill_curve_l");
+                for (int p = 0; p < FILL_CURVE_POINTS; p++) fl.add(FILL_CURVE_L[p]);
+                JsonArray fcs = resp.createNestedArray("fill_curve");
+                for (int i = 0; i < getSlotCount() && i < FLOW_MAX_SLOT; i++) {
+                    JsonArray row = fcs.add<JsonArray>();
+                    for (int p = 0; p < FILL_CURVE_POINTS; p++) row.add(fc[i * FILL_CURVE_POINTS + p]);
+                }
                 String out; serializeJson(resp, out);
                 sendData(FLOW_CALIB_TOPIC, out);
                 return;
@@ -267,9 +593,71 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
                 sendData(FLOW_CALIB_TOPIC, out);
                 return;
             }
+            if (action && !strcmp(action, "SET_PAD_WEIGHT_CURVE")) {
+                // Per-device scale curve: counts over tare → grams (strictly increasing counts)
+                float c[PAD_WEIGHT_MAX_POINTS], g[PAD_WEIGHT_MAX_POINTS];
+                uint8_t nc = 0, ng = 0;
+                for (JsonVariant v : doc["counts"].as<JsonArray>()) { if (nc < PAD_WEIGHT_MAX_POINTS) c[nc++] = v.as<float>(); }
+                for (JsonVariant v : doc["grams"].as<JsonArray>())  { if (ng < PAD_WEIGHT_MAX_POINTS) g[ng++] = v.as<float>(); }
+                bool enabled = doc["enabled"] | true;
+                bool ok = (nc == ng) && setPadWeightCurve(c, g, nc, enabled);
+                Serial.printf("[CALIB] Pad weight curve %s (%u points, gravimetric %s)\n",
+                              ok ? "saved" : "rejected", (unsigned)nc, enabled ? "on" : "off");
+                action = "GET_PAD_WEIGHT"; // reply with the stored curve
+            }
+            if (action && !strcmp(action, "TARE_PAD")) {
+                pressurePadTare();
+                action = "GET_PAD_WEIGHT";
+            }
+            if (action && !strcmp(action, "GET_PAD_WEIGHT")) {
+                // Live reading for calibrating with reference weights
+                JsonDocument resp;
+                resp["action"] = "PAD_WEIGHT";
+                resp["counts"] = pressurePadCountsOverTare();
+                resp["grams"]  = pressurePadGrams();
+                float c[PAD_WEIGHT_MAX_POINTS], g[PAD_WEIGHT_MAX_POINTS]; bool en = false;
+                uint8_t n = getPadWeightCurve(c, g, PAD_WEIGHT_MAX_POINTS, en);
+                JsonObject curve = resp.createNestedObject("curve");
+                JsonArray ca = curve.createNestedArray("counts");
+                JsonArray ga = curve.createNestedArray("grams");
+                for (uint8_t i = 0; i < n; i++) { ca.add(c[i]); ga.add(g[i]); }
+                curve["enabled"] = en;
+                String out; serializeJson(resp, out);
+                sendData(FLOW_CALIB_TOPIC, out);
+                return;
+            }
+            if (action && !strcmp(action, "RESET_ETA_MODEL")) {
+                etaModelReset();
+                action = "GET_ETA_MODEL";
+            }
+            if (action && !strcmp(action, "GET_ETA_MODEL")) {
+                // Learned pour-time corrections + how far recent ETAs were off
+                JsonDocument resp;
+                JsonObject root = resp.to<JsonObject>();
+                root["action"] = "ETA_MODEL";
+                etaModelToJson(root);
+                String out; serializeJson(resp, out);
+                sendData(FLOW_CALIB_TOPIC, out);
+                return;
+            }
+            if (action && !strcmp(action, "RESET_PRIME_MODEL")) {
+                primeModelReset();
+                action = "GET_PRIME_MODEL";
+            }
+            if (action && !strcmp(action, "GET_PRIME_MODEL")) {
+                // Learned per-line prime times + the READY_SYSTEM plan they give
+                JsonDocument resp;
+                JsonObject root = resp.to<JsonObject>();
+                root["action"] = "PRIME_MODEL";
+                primeModelToJson(root);
+                String out; serializeJson(resp, out);
+                sendData(FLOW_CALIB_TOPIC, out);
+                return;
+            }
             if (action && !strcmp(action, "START_CALIBRATION")) {
                 // Start calibration mode - turn on pump and specified number of solenoids
                 int solenoids = doc["solenoids"] | 1; // default to 1 solenoid
+                dcIdleJobsPreempt();
                 startCalibrationMode(solenoids);
                 JsonDocument resp;
                 resp["action"] = "CALIBRATION_STARTED";
@@ -278,6 +666,13 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
                 sendData(FLOW_CALIB_TOPIC, out);
                 return;
             }
+            if (action && !strcmp(action, "AUTO_CALIBRATE")) {
+                // Hands-free: measure 1..5 valve rates on the weighing pad, fit and save
+                uint32_t windowMs = doc["window_ms"] | 0;
+                dcIdleJobsPreempt();
+                startAutoCalibration(windowMs);
+                return;
+            }
             if (action && !strcmp(action, "STOP_CALIBRATION")) {
                 // Stop calibration mode - turn off pump and all solenoids
                 stopCalibrationMode();
@@ -288,6 +683,43 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
                 return;
             }
 
+            // Optional per-slot line multipliers and viscosity-class multipliers
+            JsonArray sarr = doc["slot_scale"];
+            JsonObject visc = doc["viscosity"];
+            if (!sarr.isNull() || !visc.isNull()) {
+                float ss[FLOW_MAX_SLOT]; float vs[VISC_CLASS_COUNT];
+                loadFlowScalesFromNVS(ss, FLOW_MAX_SLOT, vs, VISC_CLASS_COUNT);
+                int si = 0;
+                for (JsonVariant v : sarr) {
+                    if (si < FLOW_MAX_SLOT) ss[si++] = v.as<float>();
+                }
+                vs[VISC_ALCOHOL] = visc["alcohol"] | vs[VISC_ALCOHOL];
+                vs[VISC_MIXER]   = visc["mixer"]   | vs[VISC_MIXER];
+                vs[VISC_SOUR]    = visc["sour"]    | vs[VISC_SOUR];
+                vs[VISC_SWEET]   = visc["sweet"]   | vs[VISC_SWEET];
+                saveFlowScalesToNVS(ss, FLOW_MAX_SLOT, vs, VISC_CLASS_COUNT);
+                Serial.printf("[CALIB] Flow scales received: %d slot multipliers, visc=%.2f/%.2f/%.2f/%.2f\n",
+                              si, vs[VISC_ALCOHOL], vs[VISC_MIXER], vs[VISC_SOUR], vs[VISC_SWEET]);
+            }
+            // Optional fill-level curve for one slot (1-based): { slot, scale:[FILL_CURVE_POINTS] }
+            JsonObject fcObj = doc["fill_curve"];
+            if (!fcObj.isNull()) {
+                int slot = fcObj["slot"] | 0;
+                JsonArray sc = fcObj["scale"];
+                float scale[FILL_CURVE_POINTS];
+                int np = 0;
+                for (JsonVariant v : sc) {
+                    if (np < FILL_CURVE_POINTS) scale[np++] = v.as<float>();
+                }
+                if (slot >= 1 && slot <= getSlotCount() && np == FILL_CURVE_POINTS) {
+                    saveFillCurveToNVS(slot - 1, scale, np);
+                    Serial.printf("[CALIB] Fill curve slot %d: %.2f %.2f %.2f %.2f\n", slot, scale[0], scale[1], scale[2], scale[3]);
+                } else {
+                    Serial.println("[CALIB] Bad fill_curve (need slot and 4 scale points) – ignored.");
+                }
+            }
+            if (doc["rates_lps"].isNull()) return;
+
             // Parse array of rates (L/s), fit type, a, b
             JsonArray arr = doc["rates_lps"];
             int n = 0;
@@ -322,62 +754,6 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
         return;
     }
 
-    /* 2 · Drink command */
-    if (topicStr == AWS_PUBLISH_TOPIC) {
-        // Accept either a raw string or JSON object { command: string, override?: bool }
-        String cmd; bool overrideNoCup = false;
-        JsonDocument jdoc;
-        if (deserializeJson(jdoc, message) == DeserializationError::Ok) {
-            if (jdoc.is<JsonObject>()) {
-                cmd = jdoc["command"] | "";
-                overrideNoCup = jdoc["override"] | false;
-                if (!cmd.length()) {
-                    // also accept if message was a JSON string literal
-                    cmd = jdoc.as<const char*>();
-                }
-            } else {
-                cmd = jdoc.as<const char*>();
-            }
-        } else {
-            cmd = message;
-            if (cmd.startsWith("\"") && cmd.endsWith("\"")) {
-                cmd = cmd.substring(1, cmd.length() - 1);
-            }
-        }
-
-        Serial.printf("[AWS] Drink command received: %s\n", cmd.c_str());
-        if (getCurrentState() != State::IDLE) {
-            JsonDocument doc;
-            doc["status"] = "fail";
-            /* Distinguish *why* we're busy. */
-            switch (getCurrentState()) {
-            case State::POURING:      doc["error"] = "Device Already In Use";      break;
-            case State::MAINTENANCE:  doc["error"] = "Device In Maintenance Mode";  break;
-            default:                  doc["error"] = "Device Busy";              break;
-            }
-            String out;  serializeJson(doc, out);
-            sendData(AWS_RECEIVE_TOPIC, out);
-            Serial.printf("✖ Busy – drink rejected. Current state: %d\n", (int)getCurrentState());
-            return;
-        }
-
-        // Require cup present BEFORE starting pour unless override flag is set
-        if (!overrideNoCup && !isCupPresent()) {
-            JsonDocument doc;
-            doc["status"] = "fail";
-            doc["error"]  = "No Glass Detected - place glass to start";
-            String out; serializeJson(doc, out);
-            sendData(AWS_RECEIVE_TOPIC, out);
-            Serial.println("✖ Pour rejected – no glass detected.");
-            return; // do not change state or start the pour task
-        }
-        setState(State::POURING);
-        Serial.println("→ State set to POURING");
-        /* Kick off non-blocking FreeRTOS task with the command and override flag */
-        startPourTask(cmd, overrideNoCup);
-        return; // main loop continues running
-    }
-
     /* 3 · Slot‑config JSON or volume messages */
     if (topicStr == SLOT_CONFIG_TOPIC) {
         // Try to parse as JSON
@@ -390,6 +766,10 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
                 sendVolumeConfig();
                 return;
             }
+            if (action && strcmp(action, "ESTIMATE") == 0) {
+                handleEstimateRequest(doc, SLOT_CONFIG_TOPIC);
+                return;
+            }
             if (action && strcmp(action, "SET_VOLUME") == 0) {
                 int slot = doc["slot"];
                 float vol = doc["volume"];
@@ -430,17 +810,62 @@ void receiveData(char *topic, byte *payload, unsigned int length) {
         }
         const char *action = doc["action"];
         if (!action) return;
+        if (strcmp(action, "GET_VALVE_DIAG") == 0) {
+            // Read-only: counters kept by the SPI writer, so no idle job is preempted
+            JsonDocument resp;
+            JsonObject root = resp.to<JsonObject>();
+            dcValveDiagToJson(root);
+            root["action"] = "VALVE_DIAG";
+            String out; serializeJson(resp, out);
+            sendData(MAINTENANCE_TOPIC, out);
+            return;
+        }
+        // Cleaning tables: stored and used from the next run, no hardware touched
+        if (strcmp(action, "SET_SEQUENCE") == 0) {
+            const char *name = doc["name"] | "";
+            const char *err = mseqSetFromJson(doc.as<JsonObjectConst>());
+            char buf[128];
+            if (err) snprintf(buf, sizeof(buf), "{\"status\":\"fail\",\"action\":\"SET_SEQUENCE\",\"name\":\"%.16s\",\"error\":\"%s\"}", name, err);
+            else     snprintf(buf, sizeof(buf), "{\"status\":\"ok\",\"action\":\"SET_SEQUENCE\",\"name\":\"%.16s\"}", name);
+            sendData(MAINTENANCE_TOPIC, String(buf));
+            return;
+        }
+        if (strcmp(action, "RESET_SEQUENCE") == 0) {
+            const char *name = doc["name"] | "";
+            char buf[112];
+            snprintf(buf, sizeof(buf), "{\"status\":\"%s\",\"action\":\"RESET_SEQUENCE\",\"name\":\"%.16s\"}",
+                     mseqReset(name) ? "ok" : "fail", name);
+            sendData(MAINTENANCE_TOPIC, String(buf));
+            return;
+        }
+        if (strcmp(action, "CANCEL") == 0) {
+            // Stops the running routine at its next step boundary; it reports "cancelled" itself
+            if (!maintCancel()) {
+                sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CANCEL\",\"error\":\"idle\"}");
+            }
+            return;
+        }
+        if (strcmp(action, "GET_SEQUENCES") == 0) {
+            JsonDocument resp;
+            JsonObject root = resp.to<JsonObject>();
+            mseqToJson(root);
+            root["action"] = "SEQUENCES";
+            String out; serializeJson(resp, out);
+            sendData(MAINTENANCE_TOPIC, out);
+            return;
+        }
+        dcIdleJobsPreempt(); // maintenance drives the pump/valves directly
 
         if (strcmp(action, "DISCONNECT_WIFI") == 0) {
             sendData(MAINTENANCE_TOPIC,
                      "{\"status\":\"ok\",\"note\":\"disconnecting\"}");
             disconnectFromWiFi();    // never returns (ESP.restart)
         } else if (strcmp(action, "READY_SYSTEM") == 0) {
-            startReadySystemTask();
+            startReadySystemTask(doc["preemptible"] | false);
         } else if (strcmp(action, "EMPTY_SYSTEM") == 0) {
-            startEmptySystemTask();
+            startEmptySystemTask(doc["preemptible"] | false);
         } else if (strcmp(action, "QUICK_CLEAN") == 0) {
-            startQuickCleanTask();
+            startQuickCleanTask(doc["preemptible"] | true);
         } else if (strcmp(action, "CUSTOM_CLEAN") == 0) {
             const char *op = doc["op"] | "START";
             int slot = doc["slot"] | 0;           // 1-based
@@ -516,6 +941,7 @@ static void handleSlotConfigMessage(const String &json) {
         if (slotIdx >= 1 && slotIdx <= slotCount) {
             slotConfig[slotIdx - 1] = ingredientId;
             saveSlotConfigToNVS();
+            g_flowCalibVersion++; // ingredient decides the viscosity class → rebuild flow tables
             Serial.printf("Slot %d ← %d\n", slotIdx, ingredientId);
         } else {
             Serial.println("Slot index out of range (1‑slotCount).");
@@ -527,47 +953,110 @@ static void handleSlotConfigMessage(const String &json) {
         uint8_t slotCount = getSlotCount();
         for (uint8_t i = 0; i < slotCount; ++i) slotConfig[i] = 0;
         saveSlotConfigToNVS();
+        g_flowCalibVersion++;
         Serial.println("All slots cleared.");
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                 ESTIMATE – batched ETAs without pouring                    */
+/* -------------------------------------------------------------------------- */
+// { action:"ESTIMATE", id?, recipes:["slot:oz:prio,...", ...] }
+//   → { action:"ESTIMATES", id?, estimates:[{ eta, in_stock } | { error }] }
+static void handleEstimateRequest(JsonDocument &doc, const char *replyTopic) {
+    JsonDocument resp;
+    resp["action"] = "ESTIMATES";
+    if (!doc["id"].isNull()) resp["id"] = doc["id"];
+    JsonArray out = resp.createNestedArray("estimates");
+    size_t n = 0;
+    for (JsonVariant v : doc["recipes"].as<JsonArray>()) {
+        JsonObject e = out.add<JsonObject>();
+        if (++n > ESTIMATE_MAX_RECIPES) { e["error"] = "too_many"; continue; }
+        const char *cmd = v.as<const char*>();
+        bool inStock = false;
+        float eta = cmd ? estimateDrinkTime(cmd, &inStock) : -1.0f;
+        if (eta < 0.0f) {
+            e["error"] = "empty_command";
+        } else {
+            e["eta"] = roundf(eta * 10.0f) / 10.0f; // seconds, 0.1 s
+            e["in_stock"] = inStock;
+        }
+    }
+    String msg; serializeJson(resp, msg);
+    sendData(replyTopic, msg);
+    Serial.printf("[ESTIMATE] %u recipe(s) answered\n", (unsigned)n);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                           PUBLISH HELPERS                                  */
 /* -------------------------------------------------------------------------- */
-void sendData(const String &topic, const String &msg) {
+void sendData(const char *topic, const char *msg) {
     if (!mqttClient.connected()) {
         Serial.println("MQTT not connected; publish skipped.");
         return;
     }
     // Publish and immediately service the network to flush it out
-    if (topic != HEARTBEAT_TOPIC) {
-        Serial.printf("→ %s : %s\n", topic.c_str(), msg.c_str());
+    if (strcmp(topic, HEARTBEAT_TOPIC)) {
+        Serial.printf("→ %s : %s\n", topic, msg);
     }
-    mqttClient.publish(topic.c_str(), msg.c_str());
+    mqttClient.publish(topic, msg);
     mqttClient.loop();   // <— ensures the packet goes out right away
 }
 
+void sendData(const String &topic, const String &msg) {
+    sendData(topic.c_str(), msg.c_str());
+}
+
 void sendHeartbeat() {
     sendData(HEARTBEAT_TOPIC, "{\"msg\":\"heartbeat\"}");
 }
 
-/* ---------- Pour result notification (called from FreeRTOS task) ---------- */
-void notifyPourResult(bool success, const char *error) {
-    JsonDocument doc;
-    doc["action"] = "POUR_RESULT";
-    doc["success"] = success;
-    if (!success && error) {
-        doc["error"] = error;
+/* ---------- Deferred publish (called from tasks, never blocks) ---------- */
+bool publishDeferred(const char *topic, const char *msg) {
+    size_t len = strlen(msg);
+    portENTER_CRITICAL(&deferMux);
+    uint8_t next = (uint8_t)(deferHead + 1) % DEFER_CAP;
+    bool ok = len < sizeof(deferQ[0].body) && next != deferTail;
+    if (ok) {
+        deferQ[deferHead].topic = topic;
+        memcpy(deferQ[deferHead].body, msg, len + 1);
+        deferHead = next;
+    } else if (deferDropped < UINT16_MAX) {
+        ++deferDropped;
     }
-    serializeJson(doc, pourResultMessage);
-    pourResultPending = true;
+    portEXIT_CRITICAL(&deferMux);
+    return ok;
+}
+
+/* ---------- Pour progress (called from the pour task, never blocks) ---------- */
+void notifyPourProgress(const PourProgress &p) {
+    portENTER_CRITICAL(&progressMux);
+    progressFrame = p;
+    progressPending = true;
+    portEXIT_CRITICAL(&progressMux);
+}
+
+/* ---------- Pour result notification (called from FreeRTOS task) ---------- */
+// Formatted in place: error is one of our snake_case codes, so nothing needs escaping
+void notifyPourResult(bool success, const char *error, uint8_t drink, uint8_t count, uint8_t station) {
+    char msg[sizeof(pourResultMessage[0])];
+    int n = snprintf(msg, sizeof(msg), "{\"action\":\"POUR_RESULT\",\"success\":%s", success ? "true" : "false");
+    if (!success && error) n += snprintf(msg + n, sizeof(msg) - n, ",\"error\":\"%s\"", error);
+    if (count > 1)         n += snprintf(msg + n, sizeof(msg) - n, ",\"drink\":%u,\"count\":%u", (unsigned)drink, (unsigned)count);
+    if (station)           n += snprintf(msg + n, sizeof(msg) - n, ",\"station\":%u", (unsigned)station);
+    snprintf(msg + n, sizeof(msg) - n, "}");
+    uint8_t leg = station >= 2 ? 1 : 0;
+    portENTER_CRITICAL(&pourResultMux);
+    memcpy(pourResultMessage[leg], msg, sizeof(msg));
+    pourResultPending[leg] = true;
+    portEXIT_CRITICAL(&pourResultMux);
 }
 
 /* -------------------------------------------------------------------------- */
 /*                       NVS SAVE / LOAD HELPERS                              */
 /* -------------------------------------------------------------------------- */
 static void loadSlotConfigFromNVS() {
-    for (uint8_t i = 0; i < 15; ++i) {
+    for (uint8_t i = 0; i < SLOT_TABLE_LEN; ++i) {
         char key[8];
         snprintf(key, sizeof(key), "slot%d", i);
         slotConfig[i] = prefs.getUInt(key, 0);
@@ -579,7 +1068,7 @@ static void loadSlotConfigFromNVS() {
 }
 
 static void saveSlotConfigToNVS() {
-    for (uint8_t i = 0; i < 15; ++i) {
+    for (uint8_t i = 0; i < SLOT_TABLE_LEN; ++i) {
         char key[8];
         snprintf(key, sizeof(key), "slot%d", i);
         prefs.putUInt(key, slotConfig[i]);
@@ -615,3 +1104,9 @@ float getVolumeLitersForSlot(uint8_t slotZeroBased) {
     if (slotZeroBased >= slotCount) return 0.0f;
     return slotVolumes[slotZeroBased];
 }
+
+uint16_t getIngredientIdForSlot(uint8_t slotZeroBased) {
+    uint8_t slotCount = getSlotCount();
+    if (slotZeroBased >= slotCount) return 0;
+    return slotConfig[slotZeroBased];
+}
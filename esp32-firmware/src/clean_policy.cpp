@@ -0,0 +1,88 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: clean_policy.cpp
+ *  Description: Line-residue bookkeeping for the adaptive cleaning policy.
+ *               Touched by the pour task, maintenance tasks and the idle
+ *               cleaning job, which never run at the same time (state machine,
+ *               dcIdleJobsPreempt).
+ * -----------------------------------------------------------------------------
+ */
+
+#include "clean_policy.h"
+#include "aws_manager.h"   // getIngredientIdForSlot()
+#include "pin_config.h"    // CLEAN_RESIDUE_MAX_MS
+#include "board_profile.h" // BOARD_INGREDIENT_SLOTS
+
+static uint32_t      s_residueMask = 0;   // slots whose liquid may still be in the shared path
+static unsigned long s_residueAtMs = 0;   // last time liquid moved through the path
+static uint32_t      s_lastMask    = 0;   // previous drink's slots (repeat-order detection)
+static uint32_t      s_expectNext  = 0;   // next order when known
+
+// Ingredients that must not sit in the line: dairy, purées, chocolate (ingredients.json ids)
+static bool isPerishableIngredient(uint16_t id) {
+    return id == 45 || id == 46 || id == 47 || id == 48 || (id >= 58 && id <= 60);
+}
+
+static bool hasPerishable(uint32_t mask) {
+    for (uint8_t i = 0; i < BOARD_INGREDIENT_SLOTS; ++i) {
+        if ((mask & (1ul << i)) && isPerishableIngredient(getIngredientIdForSlot(i))) return true;
+    }
+    return false;
+}
+
+// Residue can stay if every ingredient in it is also in the next drink
+static bool compatible(uint32_t residue, uint32_t next) {
+    return (residue & ~next) == 0;
+}
+
+uint32_t cleanPolicyMask(const IngredientCommand *cmds, size_t n) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (cmds[i].slot >= 1 && cmds[i].slot <= BOARD_INGREDIENT_SLOTS && cmds[i].amount > 0.0f) mask |= 1ul << (cmds[i].slot - 1);
+    }
+    return mask;
+}
+
+bool cleanPolicyNeedsRinse(uint32_t nextMask) {
+    if (!s_residueMask) return false;
+    if ((millis() - s_residueAtMs) > CLEAN_RESIDUE_MAX_MS) return true;
+    return hasPerishable(s_residueMask) || !compatible(s_residueMask, nextMask);
+}
+
+bool cleanPolicyResidueStale() {
+    if (!s_residueMask) return false;
+    return (millis() - s_residueAtMs) > CLEAN_RESIDUE_MAX_MS || hasPerishable(s_residueMask);
+}
+
+PostPourClean cleanPolicyAfterPour(uint32_t pouredMask) {
+    uint32_t residue = s_residueMask | pouredMask;
+    if (hasPerishable(residue)) return POST_CLEAN_FULL;
+    // A known next order decides; otherwise bet on a repeat when this drink repeated the last
+    uint32_t next = s_expectNext ? s_expectNext : (pouredMask == s_lastMask ? pouredMask : 0);
+    return (next && compatible(residue, next)) ? POST_CLEAN_LIGHT : POST_CLEAN_FULL;
+}
+
+void cleanPolicyExpectNext(uint32_t nextMask) { s_expectNext = nextMask; }
+
+void cleanPolicyRecordPour(uint32_t pouredMask, PostPourClean done) {
+    if (done == POST_CLEAN_FULL) {
+        s_residueMask = 0;
+    } else {
+        s_residueAtMs = millis(); // a steady stream of repeats keeps the line fresh
+        s_residueMask |= pouredMask;
+    }
+    s_lastMask   = pouredMask;
+    s_expectNext = 0;
+    Serial.printf("[CLEAN] Policy: %s clean, residue mask 0x%lX\n",
+                  done == POST_CLEAN_FULL ? "full" : "light", (unsigned long)s_residueMask);
+}
+
+void cleanPolicyRecordClean() {
+    s_residueMask = 0;
+}
+
+void cleanPolicyMarkResidue(uint32_t slotMask) {
+    s_residueAtMs = millis();
+    s_residueMask |= slotMask;
+}
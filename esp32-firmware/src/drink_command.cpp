@@ -0,0 +1,49 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: drink_command.cpp
+ *  Description: In-place tokenizer for drink commands: walks the C string once,
+ *               no copies or temporaries. Priority sort and group split.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "drink_command.h"
+
+bool parseDrinkCommand(const char *cmd, DrinkRecipe &out) {
+  out.count = 0;
+  if (!cmd) return true;
+  const char *p = cmd;
+  while (*p) {
+    const char *end = strchr(p, ',');
+    if (!end) end = p + strlen(p);
+    // slot ':' amount [':' priority] – whitespace around fields is skipped by strtol/strtof
+    char *q;
+    long slot = strtol(p, &q, 10);
+    while (q < end && (*q == ' ' || *q == '\t')) ++q;
+    if (q > p && q < end && *q == ':') {
+      IngredientCommand ic{};
+      ic.slot   = (int)slot;
+      ic.amount = strtof(q + 1, &q);
+      while (q < end && (*q == ' ' || *q == '\t')) ++q;
+      ic.priority = (q < end && *q == ':') ? (int)strtol(q + 1, nullptr, 10) : 99;
+      if (out.count >= DRINK_MAX_ITEMS) return false;
+      out.items[out.count++] = ic;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return true;
+}
+
+void sortByPriority(IngredientCommand *items, uint8_t n) {
+  std::sort(items, items + n,
+            [](const IngredientCommand &a, const IngredientCommand &b){ return a.priority < b.priority; });
+}
+
+uint8_t priorityGroupLength(const IngredientCommand *items, uint8_t n) {
+  uint8_t len = 0;
+  while (len < n && items[len].priority == items[0].priority) ++len;
+  return len;
+}
@@ -1,41 +1,72 @@
 /*
  * ----------------------------------------------------------------------------
  *  Project: Liquor Bot
- *  File:    drink_controller.cpp — SPI (NCV7240 x2) + DRV8870 pump
+ *  File:    drink_controller.cpp — SPI (NCV7240 chain) + PWM pump
  *  Target:  ESP32 (Arduino) — non‑blocking (FreeRTOS task)
  *
  *  Summary:
- *    • Two daisy‑chained NCV7240 octal low‑side drivers over SPI control 14 solenoids
- *      — Board A (near MCU) : slots 1..6  (ingredient solenoids)
- *      — Board B (far MCU)  : slots 7..14 (ingredients 7-12 + slot 13=WATER + slot 14=TRASH/AIR)
- *      — Slot mapping: 1‑12 = ingredients, 13 = WATER flush, 14 = TRASH / AIR purge
- *    • One pump via DRV8870 H‑bridge (IN1/IN2), simple PWM on IN1 for speed control
+ *    • Daisy‑chained NCV7240 octal low‑side drivers over SPI control the slot solenoids;
+ *      chain length and slot → (chip, channel) come from board_profile.h
+ *      — Standard PCB: near chip slots 1..6, far chip slots 7..14
+ *      — Slot mapping: 1..N = ingredients, then WATER flush, then TRASH / AIR purge
+ *        (N = BOARD_INGREDIENT_SLOTS; 12 / 13 / 14 on the standard PCB)
+ *    • One pump via a low‑side MOSFET, LEDC PWM on its gate: soft‑start ramp and a
+ *      speed setpoint per phase (full speed for cleaning; regulated per open‑valve
+ *      count while pouring, so few open valves run faster up to the splash limit)
  *    • Non‑blocking pour: command string "slot:ounces[:priority],..." → FreeRTOS task
- *    • Parallel time‑slicing per priority group, proportional allocation by remaining oz
- *    • Fault‑tolerant NCV7240 writes: clears channel latches before each pour
- *    • ETA pre‑publish to AWS (sendData(...)) before starting dispense
+ *    • Batch pours: one plan poured N times, each on a freshly swapped cup, with
+ *      light cleans in between and one full clean at the end
+ *    • Per priority group, valve open/close times are planned up front (pour_planner)
+ *      and fired from an esp_timer callback — no fixed scheduler tick. The planner
+ *      caps how many valves run at once where extra valves stop adding flow.
+ *    • Flow per valve comes from flow_model (slot × open-count table incl. viscosity,
+ *      scaled by the bottle's fill level for head-pressure compensation)
+ *    • Gravimetric mode: with a pad weight curve, the timeline is re-timed from the
+ *      measured poured mass so a group ends on mass, not on open-loop time
+ *    • Fault‑tolerant NCV7240 writes: channel latches are cleared while idle
+ *    • Adaptive cleaning (clean_policy): repeat drinks skip the water flush and trash
+ *      drain; incompatible residue is rinsed to trash before the next pour
+ *    • Idle cleaning jobs: the trash drain and stale-residue rinses run after the
+ *      device is back to IDLE and give way to the next command; a pour finishes
+ *      whatever they left before its first valve opens
+ *    • ETA pre‑publish to AWS (deferred to the main loop) before starting dispense
  *
  *  Notes:
  *    - NCV7240 SPI: 16‑bit frames, MSB first, Mode 1 (CPOL=0, CPHA=1).
  *      Each channel uses 2 bits (00=STBY, 01=INPUT, 10=ON, 11=OFF).
  *    - Daisy‑chain order: send FAR device word first, NEAR device word last.
- *    - DRV8870 truth table (IN1/IN2): 10=Forward (drive), 01=Reverse, 11=Brake, 00=Coast/Sleep.
+ *    - Slot changes go to shadow words; ncvBegin()/ncvCommit() batch them so one
+ *      frame (IDF SPI master, DMA, NCV_SPI_HZ) switches every valve at once.
+ *    - Pump flow is taken as proportional to PWM duty; flow calibration runs at PUMP_SPEED_POUR.
  *
  *  Author: You & ChatGPT — Aug 2025
  * ----------------------------------------------------------------------------
  */
 
 #include <Arduino.h>
-#include <SPI.h>
-#include <vector>
 #include <algorithm>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#include <driver/ledc.h>
+#include <driver/spi_master.h>
+#include <esp_attr.h>
+#include <soc/gpio_struct.h>
 #include <ArduinoJson.h>
 #include "drink_controller.h"
+#include "pour_planner.h"
+#include "flow_model.h"
+#include "eta_model.h"
+#include "clean_policy.h"
+#include "pour_resources.h"
+#include "board_profile.h"   // BOARD_NCV_LINES, BOARD_SLOT_WATER / AIR
+#include "actuator_state.h"  // ActuatorMask, ACT_INTERLOCKS
+#include "maint_sequence.h"   // MSEQ_POUR_CLEAN
 #include "pin_config.h"      // central pin & timing configuration
 #include "state_manager.h"
-#include "aws_manager.h"     // notifyPourResult(), sendData(), LIQUORBOT_ID
+#include "aws_manager.h"     // notifyPourResult(), publishDeferred(), LIQUORBOT_ID
 #include <string.h>
 #include "led_control.h"
 #include "pressure_pad.h"
@@ -52,98 +83,257 @@ static constexpr uint8_t NCV_CMD_INPUT = 0b01; // INx parallel control (unused h
 static constexpr uint8_t NCV_CMD_ON    = 0b10; // output ON (low‑side sinks current)
 static constexpr uint8_t NCV_CMD_OFF   = 0b11; // output OFF
 
-/* Two devices in chain: index 0 = NEAR (slots 1..6), index 1 = FAR (slots 7..14) */
-static uint16_t ncvWord[2] = { 0xFFFF, 0xFFFF }; // default all channels OFF (11)
+/* One word per device in the chain: index 0 = NEAR ... BOARD_NCV_CHIPS-1 = FAR.
+ * Every channel starts OFF (11); ncvSetup() fills the words. */
+static uint16_t ncvWord[BOARD_NCV_CHIPS];
+/* Set whenever a channel is driven; cleared by the STBY→OFF pass (dcIdleService / pour). */
+static volatile bool ncvNeedsClear = true;
+/* Shadow-register transactions: ncvBegin() … ncvCommit() batches any number of slot
+ * changes into one frame. Recursive lock, so transactions nest and other tasks (the
+ * valve timeline, maintenance) wait for the frame instead of sending half of it. */
+static SemaphoreHandle_t   ncvLock = nullptr;
+static StaticSemaphore_t   ncvLockBuf;
+static uint8_t             ncvTxnDepth = 0;     // owner's nesting level (under ncvLock)
+static bool                ncvDirty = false;    // shadow differs from the last frame sent
+static spi_device_handle_t ncvDev = nullptr;    // IDF SPI master device, DMA
+DMA_ATTR static uint8_t    ncvTx[(2 * BOARD_NCV_CHIPS + 3) & ~3]; // frame, FAR word first
+DMA_ATTR static uint8_t    ncvRx[(2 * BOARD_NCV_CHIPS + 3) & ~3]; // diagnostics shifted out meanwhile
+
+/* Diagnostics read back with every frame: 2 bits per channel at the command's
+ * position. 10 = overload / thermal shutdown (ON), 01 = open load (OFF). 11 and 00
+ * mean no fault, so an unconnected MISO line (all 1s or all 0s) reports nothing. */
+static constexpr uint8_t   NCV_DIAG_OPEN_LOAD = 0b01;
+static constexpr uint8_t   NCV_DIAG_OVERLOAD  = 0b10;
+static uint32_t            ncvFitted = 0;              // slots with a solenoid on this unit
+static volatile uint32_t   ncvOpenMask = 0;            // latest frame, bit 0 = slot 1
+static volatile uint32_t   ncvOverMask = 0;
+static uint32_t            ncvFrames = 0;
+static uint16_t            ncvOpenCount[BOARD_SPI_SLOTS] = {0}; // fault onsets per slot since boot
+static uint16_t            ncvOverCount[BOARD_SPI_SLOTS] = {0};
+
+/* Idle cleaning jobs (dcIdleService → idleCleanTask). Hardware is handed over by
+ * dcIdleJobsPreempt(); the owed drain survives a preemption and the next pour runs it. */
+static volatile uint32_t      idleDrainLeftMs  = 0;  // trash drain the line is still owed
+static volatile bool          idleJobRunning   = false;
+static volatile bool          idleJobStop      = false;
+static volatile unsigned long idleJobNotBefore = 0;  // millis() before which no job starts
 
 /* -------------------------- Types ---------------------------- */
-struct PourState { int slot; float ouncesLeft; bool done; };
+/* Progress of the running pour, in expected (ETA-model) seconds. Segments are the
+ * pour's phases and priority groups; the pour task advances them and progressTick()
+ * turns the position into a coalesced progress frame at most every periodMs. */
+enum PourPhase : uint8_t { PH_WAIT_CUP, PH_RINSE, PH_START, PH_POUR, PH_FLUSH, PH_PURGE };
+static const char *const POUR_PHASE_NAMES[] = { "wait_cup", "rinse", "start", "pour", "flush", "purge" };
+
+/* Pre-pour rinse of incompatible residue: water then air, routed to trash */
+static constexpr uint32_t RINSE_MS = CLEAN_WATER_MS + CLEAN_TRASH_MS;
+struct PourState {
+  bool          active;
+  uint8_t       phase;        // PourPhase
+  uint8_t       group, groups;
+  float         totalSec;     // expected seconds to drink ready (the published eta)
+  float         doneSec;      // expected seconds of finished segments
+  float         segSec;       // expected seconds of the current segment
+  unsigned long segStartMs;
+  uint16_t      periodMs;     // min spacing of frames
+  unsigned long lastFrameMs;
+  bool          paused;
+};
+static PourState pst = {};
+
+/* Timeline executor: valve events of the active PourPlan are fired from an esp_timer
+ * callback (esp_timer task context, so SPI is allowed). Plan time only advances while
+ * the pump runs; a cup-removal pause shifts the remaining events by the pause length. */
+struct TimelineRun {
+  const PourPlan *plan;
+  uint8_t         next;      // index of the next event to fire
+  int64_t         startUs;   // wall time of plan t=0 (shifted on resume and by mass feedback)
+  int64_t         baseStartUs; // open-loop t=0 (shifted on resume only)
+  int64_t         pausedAtUs;
+  uint8_t         open;      // valves open now (selects the regulated pump speed)
+  bool            paused;
+  volatile bool   finished;
+  TaskHandle_t    waiter;    // task notified when the last event has fired
+};
+static TimelineRun        tlRun = {};
+static esp_timer_handle_t tlTimer = nullptr;
+static portMUX_TYPE       tlMux = portMUX_INITIALIZER_UNLOCKED;
+static constexpr uint32_t TL_SLACK_US = 200; // fire events due within this window together
+
+/* Pump PWM: duty moves towards the setpoint in PUMP_RAMP_STEP_MS steps from an esp_timer,
+ * so a soft-start never blocks the caller and pumpOff() always wins immediately. */
+static constexpr uint32_t PUMP_DUTY_MAX = (1u << PUMP_PWM_RES_BITS) - 1;
+static esp_timer_handle_t pumpRampTimer = nullptr;
+static portMUX_TYPE       pumpMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t           pumpDutyNow = 0, pumpDutyTarget = 0, pumpDutyStep = 1;
+static volatile int64_t   pumpRampEndUs = 0;   // when the current soft-start reaches its setpoint
+static volatile uint8_t   pourPumpPct = PUMP_SPEED_POUR; // regulated speed for the valves open now
+
+/* Stock held for accepted orders (queued or pouring) that is not yet off slotVolumes.
+ * Taken by dcReserveStock() on the MQTT loop, returned drink by drink by the pour task. */
+static float              heldOz[BOARD_INGREDIENT_SLOTS] = {0};
+static portMUX_TYPE       stockMux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Time left of the running pour, for queue start-time predictions (dcPourSecondsLeft) */
+static volatile unsigned long pourDrinkEndMs = 0;   // expected ready time of the current drink
+static volatile uint8_t       pourDrinksAfter = 0;  // batch drinks still to come after it
+static volatile float         pourDrinkSec    = 0;  // expected seconds of each of those
+
+/* Pour and LED cue workers: created once (static stacks), fed through queues, so a
+ * pour costs one queue send and no heap. A pour item carries its own command copy. */
+struct PourTaskParams { char cmd[ORDER_CMD_MAX]; bool overrideNoCup; uint8_t progressHz; int64_t rxUs; uint8_t count; uint8_t station; };
+enum LedCue : uint8_t { LED_CUE_FADE_RED, LED_CUE_SUCCESS };
+static constexpr uint32_t POUR_TASK_STACK = 8192;
+static constexpr uint32_t LED_TASK_STACK  = 2048;
+static StaticTask_t       pourTaskTcb, ledTaskTcb;
+static StackType_t        pourTaskStack[POUR_TASK_STACK], ledTaskStack[LED_TASK_STACK];
+static StaticQueue_t      pourQueueBuf, ledQueueBuf;
+static uint8_t            pourQueueStore[sizeof(PourTaskParams)];
+static uint8_t            ledQueueStore[4];
+static QueueHandle_t      pourQueue = nullptr, ledQueue = nullptr;
+/* Idle cleaning worker: same idea, woken by a task notification from dcIdleService() */
+static constexpr uint32_t IDLE_TASK_STACK = 3072;
+static StaticTask_t       idleTaskTcb;
+static StackType_t        idleTaskStack[IDLE_TASK_STACK];
+static TaskHandle_t       idleTask = nullptr;
+
+/* Station of the current pour (0 = A, 1 = B on dual-station builds) and its outlet
+ * paths. Set by the pour task for the length of one pour. */
+static uint8_t            pourStation = 0;
+static uint8_t            pourOutlets = STATION_A_POUR_OUTS, purgeOutlets = STATION_A_PURGE_OUTS;
+
+/* First valve fault seen during the current drink (0 = none), or an actuator target
+ * the interlocks refused; either stops the drink. Set by the pour task. */
+static uint8_t            pourFaultSlot = 0;
+static bool               pourFaultOverload = false;
+static bool               pourRefused = false;
+
+/* The flow model's fill factors are shared state: the pour task and MQTT estimates
+ * both run refresh → updateFill → plan, so each sequence holds this lock. */
+static SemaphoreHandle_t  planLock = nullptr;
 
 /* Forward decls */
 static void         pumpSetup();
-static void         pumpOn();
+static void         pumpOn(uint8_t pct = PUMP_SPEED_CLEAN);
 static void         pumpOff();
+static void         pumpRampCb(void *arg);
+static int64_t      pumpRampDebtUs();
 // Outlet solenoids (GPIO direct)
 static void         outletSolenoidsSetup();
-static void         outletSolenoidSet(uint8_t idx, bool on); // idx 1..4
-static void         outletAllOff();
-static void         outletSetState(bool s1, bool s2, bool s3, bool s4);
+static void         outletWrite(uint8_t mask);               // bit 0 = OUT1; only via actApply()
+static bool         actApply(ActuatorMask m, uint8_t pumpPct = PUMP_SPEED_CLEAN);
+static bool         pourCupPresent();
+static uint8_t      pourResultStation();
 static void         ncvSetup();
 static void         ncvFlush();
 static inline void  ncvSetPair(uint16_t &word, uint8_t ch/*1..8*/, uint8_t cmd);
-static void         ncvSetSlot(int slot/*1..16*/, bool on);
+static bool         ncvSlotToChannel(int slot, uint8_t &chip, uint8_t &ch);
+static void         ncvSetSlot(int slot/*1..BOARD_SPI_SLOTS*/, bool on);
+static void         ncvBegin();
+static void         ncvCommit();
+static uint32_t     ncvFaulted();
+static void         ncvDecodeDiag(uint32_t &newOpen, uint32_t &newOver);
+static uint32_t     ncvOnMask();
 static void         ncvAll(uint8_t cmd);
-static void         ncvWriteBoth();
-static void         dispenseParallelGroup(std::vector<IngredientCommand> &group, bool overrideNoCup = false);
-static float        flowRate(int numOpen);
+static void         ncvWriteChain();
+static uint32_t     dispenseParallelGroup(const IngredientCommand *group, size_t n, bool overrideNoCup = false);
+static void         timelineSetup();
+static void         timelineTimerCb(void *arg);
+static void         timelineArmNext();
+static void         timelineStart(const PourPlan &plan);
+static void         timelinePause();
+static void         timelineResume();
+static void         timelineWarpToMass(const float *gramsAtEvent, float measuredG);
 static uint8_t      getIngredientCountFromId();
 static bool         isValidIngredientSlot(int slot);
-static float        estimatePourTime(const std::vector<IngredientCommand> &parsed);
-static void         pourDrinkTask(void *param);
-// LED success cue task (non-blocking)
-static void         ledSuccessTask(void *param);
+static bool         checkStock(const IngredientCommand *cmds, size_t n, bool verbose, uint8_t count = 1);
+static void         stockRelease(const IngredientCommand *cmds, size_t n, uint8_t count);
+static uint8_t      batchCount(uint8_t count);
+static bool         pourValveFault(uint32_t faulted);
+static void         pourReportFault(uint8_t drink, uint8_t count);
+static bool         parseValid(const char *commandStr, DrinkRecipe &out);
+static float        estimatePourTime(const IngredientCommand *cmds, size_t n, float *plannedSec = nullptr);
+static void         pourWorkerTask(void *param);
+static void         pourDrink(const PourTaskParams &pp);
+static void         progressBegin(float totalSec, uint8_t groups, uint8_t hz);
+static void         progressPhase(PourPhase phase, float segSec, uint8_t group = 0);
+static void         progressTick(bool force = false);
+static void         progressSleep(uint32_t ms);
+static void         pourCleanStep(const MaintStep &st);
+static void         pourCleanTick();
+// LED cue tasks (non-blocking)
+static void         ledCueTask(void *param);
+static bool         ledCue(LedCue cue);
+static void         ncvClearFaults();
+static void         rinseLineToTrash();
+static void         drainLineToTrash(uint32_t ms);
+static void         idleCleanTask(void *param);
 
 /* Public wrappers used by maintenance_controller */
-void dcSetSpiSlot(int slot, bool on) { ncvSetSlot(slot, on); }
-void dcOutletSetState(bool s1, bool s2, bool s3, bool s4) { outletSetState(s1,s2,s3,s4); }
-void dcOutletAllOff() { outletAllOff(); }
-void dcPumpOn() { pumpOn(); }
-void dcPumpOff() { pumpOff(); }
+bool dcApplyActuators(ActuatorMask m, uint8_t pumpPct) { return actApply(m, pumpPct); }
+void dcPlanLock()   { if (planLock) xSemaphoreTake(planLock, portMAX_DELAY); }
+void dcPlanUnlock() { if (planLock) xSemaphoreGive(planLock); }
 uint8_t dcGetIngredientCount() { return getIngredientCountFromId(); }
 
 /* ============================================================================================ */
 /*                                           INIT                                               */
 /* ============================================================================================ */
 void initDrinkController() {
-  // SPI for NCV7240
-  SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI, SPI_CS);
-  pinMode(SPI_CS, OUTPUT);
-  digitalWrite(SPI_CS, HIGH);
   // Optional control pins
   if (NCV_EN_PIN >= 0) { pinMode(NCV_EN_PIN, OUTPUT); digitalWrite(NCV_EN_PIN, HIGH); }
   if (NCV_LHI_PIN >= 0) { pinMode(NCV_LHI_PIN, OUTPUT); digitalWrite(NCV_LHI_PIN, LOW); }
   ncvSetup();
 
-  // DRV8870 pump
+  // Pump (LEDC PWM on the MOSFET gate)
   pumpSetup();
 
   // Outlet solenoids
   outletSolenoidsSetup();
 
+  // Valve timeline timer
+  timelineSetup();
+  planLock = xSemaphoreCreateMutex();
+
+  // Pour + LED workers (static: no per-pour task creation or heap)
+  pourQueue = xQueueCreateStatic(1, sizeof(PourTaskParams), pourQueueStore, &pourQueueBuf);
+  ledQueue  = xQueueCreateStatic(sizeof(ledQueueStore), 1, ledQueueStore, &ledQueueBuf);
+  xTaskCreateStaticPinnedToCore(pourWorkerTask, "PourTask", POUR_TASK_STACK, nullptr, 1, pourTaskStack, &pourTaskTcb, 1);
+  xTaskCreateStaticPinnedToCore(ledCueTask, "LedCue", LED_TASK_STACK, nullptr, 1, ledTaskStack, &ledTaskTcb, 1);
+  idleTask = xTaskCreateStaticPinnedToCore(idleCleanTask, "IdleClean", IDLE_TASK_STACK, nullptr, 1, idleTaskStack, &idleTaskTcb, 1);
+
   Serial.println("DrinkController: SPI+NCV7240 ready, pump ready.");
 }
 
 /* ============================================================================================ */
 /*                                   PUBLIC API (non‑blocking)                                  */
 /* ============================================================================================ */
-struct PourTaskParams { char *cmd; bool overrideNoCup; };
-
-void startPourTask(const String &commandStr, bool overrideNoCup) {
-  char *buf = strdup(commandStr.c_str());
-  if (!buf) {
-    Serial.println("❌ strdup failed – OOM");
-    setState(State::ERROR);
-    ledError();
-    notifyPourResult(false, "alloc_fail");
-    return;
-  }
-  PourTaskParams *p = (PourTaskParams*)malloc(sizeof(PourTaskParams));
-  if (!p) {
-    Serial.println("❌ malloc failed – OOM (params)");
-    setState(State::ERROR);
-    ledError();
-    free(buf);
-    notifyPourResult(false, "alloc_fail");
+void startPourTask(const char *commandStr, bool overrideNoCup, uint8_t progressHz, int64_t commandRxUs, uint8_t count,
+                   uint8_t station) {
+  // Copied into the queue item – the caller's buffer can go away. Dispatch rejects
+  // longer commands (parseValid), so a truncated copy would be a recipe nobody reserved.
+  // Stock was reserved for batchCount(count): every failure releases exactly that.
+  PourTaskParams p;
+  p.count = batchCount(count);
+  p.station = station < POUR_STATIONS ? station : 0;
+  const uint8_t resultStation = POUR_STATIONS > 1 ? p.station + 1 : 0;
+  size_t len = commandStr ? strlen(commandStr) : 0;
+  if (len >= sizeof(p.cmd)) {
+    Serial.println("❌ Pour command longer than ORDER_CMD_MAX – not poured");
+    setState(State::IDLE);
+    dcReleaseStock(commandStr, p.count);
+    notifyPourResult(false, "command_too_long", 0, 0, resultStation);
     return;
   }
-  p->cmd = buf;
-  p->overrideNoCup = overrideNoCup;
-  if (xTaskCreatePinnedToCore(pourDrinkTask, "PourTask", 8192, p, 1, nullptr, 1) != pdPASS) {
-    Serial.println("❌ xTaskCreatePinnedToCore failed");
+  memcpy(p.cmd, commandStr ? commandStr : "", len + 1);
+  p.overrideNoCup = overrideNoCup;
+  p.progressHz = progressHz > PROGRESS_HZ_MAX ? PROGRESS_HZ_MAX : progressHz;
+  p.rxUs = commandRxUs ? commandRxUs : esp_timer_get_time();
+  if (!pourQueue || xQueueSend(pourQueue, &p, 0) != pdTRUE) {
+    Serial.println("❌ Pour worker not available");
     setState(State::ERROR);
     ledError();
-    free(buf);
-    free(p);
-    notifyPourResult(false, "task_fail");
+    dcReleaseStock(p.cmd, p.count);
+    notifyPourResult(false, "task_fail", 0, 0, resultStation);
   }
 }
 
@@ -152,468 +342,1007 @@ void startPourTask(const String &commandStr, bool overrideNoCup) {
 /* ============================================================================================ */
 
 
-static void pourDrinkTask(void *param) {
-  PourTaskParams *pp = static_cast<PourTaskParams*>(param);
-  String cmdStr(pp->cmd);
-  bool overrideNoCup = pp->overrideNoCup;
-  free(pp->cmd);
-  free(pp);
+// Long-lived: one pour at a time, taken from pourQueue (no task or heap per pour).
+static void pourWorkerTask(void *param) {
+  PourTaskParams job;
+  for (;;) {
+    if (xQueueReceive(pourQueue, &job, portMAX_DELAY) == pdTRUE) pourDrink(job);
+  }
+}
+
+static void pourDrink(const PourTaskParams &pp) {
+  bool overrideNoCup = pp.overrideNoCup;
+  uint8_t progressHz = pp.progressHz;
+  uint8_t count      = pp.count;
+  // Launch stage timestamps (us): command received → ... → pump on
+  struct { int64_t rx, task, parsed, stock, eta, ncv, cup, pump; } lt = {};
+  lt.rx   = pp.rxUs;
+  lt.task = esp_timer_get_time();
 
   setState(State::POURING);
   Serial.println("→ State set to POURING");
 
-  // Parse command
-  auto parsed = parseDrinkCommand(cmdStr);
-  // Filter to valid slots (ingredient slots 1..N + 13/14)
-  {
-    std::vector<IngredientCommand> filtered;
-    for (auto &c : parsed) {
-  if (isValidIngredientSlot(c.slot)) filtered.push_back(c);
-      else Serial.printf("(skip slot %d – not present on this device)\n", c.slot);
-    }
-    parsed.swap(filtered);
+  // Parse in place and keep valid slots (ingredient slots 1..N + water/air)
+  static DrinkRecipe parsed; // only one pour runs at a time
+  bool whole = parseDrinkCommand(pp.cmd, parsed);
+  uint8_t kept = 0;
+  for (uint8_t k = 0; k < parsed.count; ++k) {
+    if (isValidIngredientSlot(parsed.items[k].slot)) parsed.items[kept++] = parsed.items[k];
+    else Serial.printf("(skip slot %d – not present on this device)\n", parsed.items[k].slot);
   }
-
-  if (parsed.empty()) {
-    notifyPourResult(false, "empty_command");
+  parsed.count = kept;
+  // Both stations' spouts hang off the one manifold, so a pour owns it alone;
+  // the order queue runs paired orders back to back (pour_resources.h)
+  pourStation  = pp.station;
+  pourOutlets  = prPourOutlets(pourStation);
+  purgeOutlets = prPurgeOutlets(pourStation);
+  lt.parsed = esp_timer_get_time();
+
+  // Dispatch rejects both (parseValid), so no stock is held for them; never pour part of a recipe
+  if (!whole || !parsed.count) {
+    notifyPourResult(false, whole ? "empty_command" : "too_many_ingredients", 0, 0, pourResultStation());
     setState(State::ERROR);
     ledError();
-    vTaskDelete(nullptr);
+    return;
   }
 
-  // Pre-pour stock check (convert recipe oz to liters, compare with stored liters)
+  // Stock for the whole batch was reserved when the order was accepted (dcReserveStock)
+  lt.stock = esp_timer_get_time();
+
+  // Cleaning between drinks (decided now so the ETA below matches what will run).
+  // Inside a batch the next drink is this one again.
+  uint32_t      recipeMask = cleanPolicyMask(parsed.items, parsed.count);
+  bool          needRinse  = cleanPolicyNeedsRinse(recipeMask);
+  if (count > 1) cleanPolicyExpectNext(recipeMask);
+  PostPourClean postClean  = cleanPolicyAfterPour(recipeMask);
+
+  // ETA – published by the main loop so the pour never waits on MQTT
+  float plannedSec = 0.0f;
+  float eta = estimatePourTime(parsed.items, parsed.count, &plannedSec);
   {
-    uint8_t maxIngr = getIngredientCountFromId();
-    float needOz[15] = {0};
-    for (auto &ic : parsed) {
-      if (ic.slot >= 1 && ic.slot <= maxIngr) {
-        needOz[ic.slot - 1] += ic.amount;
-      }
-    }
-    bool insufficient = false;
-    for (uint8_t i = 0; i < maxIngr && i < 15; ++i) {
-      if (needOz[i] <= 0) continue;
-      float needL = needOz[i] / 33.814f;
-      float haveL = getVolumeLitersForSlot(i);
-      if (haveL + 1e-6f < needL) { // small epsilon
-        insufficient = true;
-        Serial.printf("[STOCK] Slot %u needs %.3f L but has %.3f L — insufficient.\n", (unsigned)(i+1), needL, haveL);
-      }
-    }
-    if (insufficient) {
-    JsonDocument doc;
-      doc["status"] = "fail";
-      doc["error"] = "Insufficient ingredients";
-      String out; serializeJson(doc, out);
-      sendData(AWS_RECEIVE_TOPIC, out);
-      notifyPourResult(false, "insufficient_ingredients");
-      setState(State::IDLE);
-      ledIdle();
-      vTaskDelete(nullptr);
+    char msg[80];
+    if (count > 1) snprintf(msg, sizeof(msg), "{\"status\":\"eta\",\"eta\":%.2f,\"drink\":1,\"count\":%u}", eta, (unsigned)count);
+    else           snprintf(msg, sizeof(msg), "{\"status\":\"eta\",\"eta\":%.2f}", eta);
+    publishDeferred(AWS_RECEIVE_TOPIC, msg);
+  }
+  pourDrinkEndMs  = millis() + (unsigned long)(eta * 1000.0f);
+  pourDrinksAfter = count - 1;
+  pourDrinkSec    = eta;
+  lt.eta = esp_timer_get_time();
+  // Sort by priority; distinct priorities = number of groups the pour will run
+  sortByPriority(parsed.items, parsed.count);
+  uint8_t groups = 0;
+  for (uint8_t k = 0; k < parsed.count; k += priorityGroupLength(parsed.items + k, parsed.count - k)) ++groups;
+  // Phase timestamps for the ETA model (same span the "eta" status promises)
+  unsigned long etaT0 = millis();
+  progressBegin(eta, groups, progressHz);
+  progressPhase(PH_WAIT_CUP, etaModelPhaseSec(ETA_PH_PREP));
+
+  // Take the hardware from an idle cleaning job (it has seen POURING and is stopping)
+  dcIdleJobsPreempt();
+  // NCV faults are normally cleared while idle; only pay for it here if something ran since
+  if (ncvNeedsClear) ncvClearFaults();
+  lt.ncv = esp_timer_get_time();
+
+  // Residue from the previous drink does not belong in this one → rinse to trash first.
+  // Otherwise finish a trash drain the idle job did not get to (water left in the line).
+  uint32_t rinseMs = 0;
+  if (needRinse || idleDrainLeftMs) {
+    unsigned long t = millis();
+    if (needRinse) {
+      progressPhase(PH_RINSE, RINSE_MS / 1000.0f);
+      rinseLineToTrash();
+      cleanPolicyRecordClean();
+    } else {
+      progressPhase(PH_RINSE, idleDrainLeftMs / 1000.0f);
+      drainLineToTrash(idleDrainLeftMs);
     }
+    idleDrainLeftMs = 0;
+    rinseMs = millis() - t;
+    progressPhase(PH_WAIT_CUP, 0.0f);
   }
 
-  // Log details + ETA
-  Serial.println("📋 Recipe details:");
-  for (auto &ic : parsed) {
-    Serial.printf("   • Slot %2d → %5.2f oz   (prio %d)\n", ic.slot, ic.amount, ic.priority);
-  }
-  float eta = estimatePourTime(parsed);
-  Serial.printf("Estimated total pour time: %.2f s\n", eta);
-  Serial.println("---------------------------------");
-  {
-    JsonDocument doc;
-    doc["status"] = "eta";
-    doc["eta"]    = eta; // seconds
-    String out; serializeJson(doc, out);
-    sendData(AWS_RECEIVE_TOPIC, out);
-  }
-
-  // Clear NCV faults and ensure OFF baseline
-  Serial.println("[INIT] Clearing NCV7240 faults and forcing all outputs OFF");
-  ncvAll(NCV_CMD_STBY); // clear latches per‑channel
-  ncvAll(NCV_CMD_OFF);  // baseline OFF (slots 1..16)
-
-  // Guard: require cup present before starting pour unless override flag is set
-  if (!overrideNoCup) {
-    Serial.println("[SAFETY] Waiting for cup on pressure pad before pour...");
-    // If no cup at start, notify app immediately (single message) and continue waiting
-    if (!isCupPresent()) {
-      JsonDocument doc;
-      doc["status"] = "fail";
-      doc["error"]  = "No Glass Detected - place glass to start";
-      String out; serializeJson(doc, out);
-      sendData(AWS_RECEIVE_TOPIC, out);
-    }
-    unsigned long waitStart = millis();
-    while (!isCupPresent()) {
-      if ((millis() - waitStart) > 30000UL) {
-        Serial.println("[SAFETY] No cup detected within 30s. Aborting pour.");
-        notifyPourResult(false, "no_cup");
-        setState(State::IDLE);
-        ledIdle();
-        vTaskDelete(nullptr);
+  for (uint8_t drink = 1; drink <= count; ++drink) {
+    bool first = drink == 1;
+    uint32_t pausedMs = 0;
+    pourFaultSlot = 0;
+    pourRefused = false;
+
+    if (!first) {
+      // Same plan again: only the clean after it and the cup swap differ
+      PostPourClean lastClean = postClean;
+      if (drink < count) cleanPolicyExpectNext(recipeMask);
+      postClean = drink == count ? POST_CLEAN_FULL : cleanPolicyAfterPour(recipeMask); // one full clean ends the batch
+      eta = etaModelPredict(plannedSec, groups, postClean == POST_CLEAN_LIGHT) - etaModelPhaseSec(ETA_PH_PREP);
+      progressBegin(eta, groups, progressHz);
+      progressPhase(PH_WAIT_CUP, 0.0f);
+
+      // A fresh cup: the filled one lifted off the pad, then an empty one put down
+      Serial.printf("[BATCH] Drink %u/%u: waiting for the cup to be swapped\n", (unsigned)drink, (unsigned)count);
+      bool swapped = false;
+      bool lifted  = !pourCupPresent();
+      unsigned long waitStart = millis();
+      while ((millis() - waitStart) <= BATCH_CUP_SWAP_MS) {
+        bool present = pourCupPresent();
+        if (!present) lifted = true;
+        else if (lifted) { swapped = true; break; }
+        progressSleep(50);
       }
-      delay(50);
+      if (!swapped) {
+        Serial.printf("[BATCH] No fresh cup within %lu s – batch stopped after %u/%u\n",
+                      (unsigned long)(BATCH_CUP_SWAP_MS / 1000), (unsigned)(drink - 1), (unsigned)count);
+        pst.active = false;
+        cleanPolicyExpectNext(0);
+        notifyPourResult(false, "no_cup", drink, count, pourResultStation());
+        stockRelease(parsed.items, parsed.count, count - drink + 1);
+        // The batch's full clean never came; rinse to trash (a filled cup may still be on the pad)
+        if (lastClean == POST_CLEAN_LIGHT) {
+          rinseLineToTrash();
+          cleanPolicyRecordClean();
+        }
+        break;
+      }
+      etaT0 = millis();
+      pourDrinkEndMs  = etaT0 + (unsigned long)(eta * 1000.0f);
+      pourDrinksAfter = count - drink;
+      char msg[80];
+      snprintf(msg, sizeof(msg), "{\"status\":\"eta\",\"eta\":%.2f,\"drink\":%u,\"count\":%u}", eta, (unsigned)drink, (unsigned)count);
+      publishDeferred(AWS_RECEIVE_TOPIC, msg);
+    } else if (!overrideNoCup) {
+      // Guard: require cup present before starting pour unless override flag is set
+      Serial.println("[SAFETY] Waiting for cup on pressure pad before pour...");
+      // If no cup at start, notify app immediately (single message) and continue waiting
+      if (!pourCupPresent()) {
+        publishDeferred(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"No Glass Detected - place glass to start\"}");
+      }
+      unsigned long waitStart = millis();
+      while (!pourCupPresent()) {
+        if ((millis() - waitStart) > 30000UL) {
+          Serial.println("[SAFETY] No cup detected within 30s. Aborting pour.");
+          pst.active = false;
+          cleanPolicyExpectNext(0);
+          notifyPourResult(false, "no_cup", drink, count, pourResultStation());
+          stockRelease(parsed.items, parsed.count, count);
+          setState(State::IDLE);
+          ledIdle();
+          return;
+        }
+        progressSleep(50);
+      }
+      Serial.println("[SAFETY] Cup detected. Proceeding with pour.");
+    } else {
+      Serial.println("[SAFETY] Override enabled – skipping cup presence check.");
     }
-    Serial.println("[SAFETY] Cup detected. Proceeding with pour.");
-  } else {
-    Serial.println("[SAFETY] Override enabled – skipping cup presence check.");
-  }
 
-  // Now that we are actually starting the pour, fade LED to red
-  fadeToRed();
+    unsigned long tPrepEnd = millis();
+    lt.cup = esp_timer_get_time();
+    progressPhase(PH_START, etaModelPhaseSec(ETA_PH_START));
 
-  // Set up outlet solenoids for pour (OUT1=ON, OUT3=ON) and start pump
-  Serial.println("[POUR] Setting up outlet solenoids and starting pump");
-  outletSetState(true, false, true, false);
-  pumpOn();
+    // Now that we are actually starting the pour, fade LED to red (in the background)
+    if (!ledCue(LED_CUE_FADE_RED)) fadeToRed();
 
-  // Ensure slot 13 (water) and slot 14 (trash/air) are CLOSED for ingredient pour
-  Serial.println("[POUR] Ensuring slot 13 (water) and slot 14 (trash/air) are CLOSED");
-  ncvSetSlot(13, false);
-  ncvSetSlot(14, false);
+    // Zero the scale with the empty cup on it (gravimetric mode)
+    if (!overrideNoCup && !pourStation && pressurePadWeightReady()) { // pad B only senses presence
+      pressurePadTare();
+      Serial.println("[GRAV] Pad tared – pours close on measured mass");
+    }
 
-  // Sort by priority
-  std::sort(parsed.begin(), parsed.end(),
-            [](const IngredientCommand &a, const IngredientCommand &b){ return a.priority < b.priority; });
+    // The station's spout path (station A: OUT1+OUT3) open, every valve closed –
+    // water and trash/air included – and the pump on, as one checked step
+    Serial.println("[POUR] Opening the spout path, valves closed, starting pump");
+    pourPumpPct = PUMP_SPEED_POUR;
+    // Soft-start; the timeline sets the speed for each open-valve count
+    pourRefused = !actApply(actOutlets(pourOutlets) | ACT_PUMP, pourPumpPct);
+    lt.pump = esp_timer_get_time();
+    // The recipe's lines are closed now – the moment an open load shows. The
+    // cleanup and start frames' readback is already decoded; no extra frame.
+    if (pourRefused || pourValveFault(ncvFaulted() & recipeMask)) {
+      actApply(0);
+      pst.active = false;
+      cleanPolicyExpectNext(0);
+      pourReportFault(drink, count);
+      stockRelease(parsed.items, parsed.count, count - drink + 1);
+      break;
+    }
+    unsigned long tStartEnd = millis();
+
+    if (first) {
+      // Logging and the launch report happen after pump on – serial output costs time
+      Serial.println("📋 Recipe details:");
+      for (uint8_t k = 0; k < parsed.count; ++k) {
+        const IngredientCommand &ic = parsed.items[k];
+        Serial.printf("   • Slot %2d → %5.2f oz   (prio %d)\n", ic.slot, ic.amount, ic.priority);
+      }
+      Serial.printf("Estimated total pour time: %.2f s (valves %.2f s)\n", eta, plannedSec);
+      if (count > 1) Serial.printf("Batch of %u – one full clean at the end\n", (unsigned)count);
+      Serial.println("---------------------------------");
+      float ms[7] = { (lt.task - lt.rx) / 1000.0f, (lt.parsed - lt.task) / 1000.0f, (lt.stock - lt.parsed) / 1000.0f,
+                      (lt.eta - lt.stock) / 1000.0f, (lt.ncv - lt.eta) / 1000.0f, (lt.cup - lt.ncv) / 1000.0f,
+                      (lt.pump - lt.cup) / 1000.0f };
+      float total  = (lt.pump - lt.rx) / 1000.0f;
+      float budget = total - ms[5]; // the guest's cup wait is not ours
+      Serial.printf("[LAUNCH] rx→pump %.1f ms (dispatch %.1f, parse %.1f, stock %.1f, eta %.1f, ncv %.1f, cup %.1f, start %.1f)\n",
+                    total, ms[0], ms[1], ms[2], ms[3], ms[4], ms[5], ms[6]);
+      if (budget > LAUNCH_BUDGET_MS) {
+        Serial.printf("[LAUNCH] ⚠ %.1f ms over the %u ms budget (cup wait excluded)\n", budget - LAUNCH_BUDGET_MS, (unsigned)LAUNCH_BUDGET_MS);
+      }
+      char msg[256];
+      snprintf(msg, sizeof(msg),
+               "{\"status\":\"started\",\"latency_ms\":%.1f,\"stages_ms\":{\"dispatch\":%.1f,\"parse\":%.1f,"
+               "\"stock\":%.1f,\"eta\":%.1f,\"ncv\":%.1f,\"cup\":%.1f,\"start\":%.1f}}",
+               total, ms[0], ms[1], ms[2], ms[3], ms[4], ms[5], ms[6]);
+      publishDeferred(AWS_RECEIVE_TOPIC, msg);
+    }
 
-  size_t i = 0;
-  while (i < parsed.size()) {
-    int pr = parsed[i].priority;
-    std::vector<IngredientCommand> group;
-    while (i < parsed.size() && parsed[i].priority == pr) { group.push_back(parsed[i]); ++i; }
-    Serial.printf("\n— Priority %d (%u items) —\n", pr, (unsigned)group.size());
-    Serial.println("[POUR] Starting ingredient pour (after pressurization)");
-    dispenseParallelGroup(group, overrideNoCup);
-  }
+    // Groups are runs of equal priority in the sorted recipe – passed in place
+    uint8_t i = 0;
+    while (i < parsed.count && !pourFaultSlot && !pourRefused) {
+      int pr = parsed.items[i].priority;
+      uint8_t n = priorityGroupLength(parsed.items + i, parsed.count - i);
+      Serial.printf("\n— Priority %d (%u items) —\n", pr, (unsigned)n);
+      Serial.println("[POUR] Starting ingredient pour (after pressurization)");
+      pausedMs += dispenseParallelGroup(parsed.items + i, n, overrideNoCup);
+      i += n;
+    }
+    unsigned long tDispenseEnd = millis();
+    // A valve fault stopped the pour: no water into the failed drink; the next
+    // order's rinse (or the idle job) takes the residue
+    bool faulted = pourFaultSlot || pourRefused;
+    if (faulted) postClean = POST_CLEAN_LIGHT;
+
+    // Finish dispense: pump off and every valve closed in one step; the spout path
+    // stays open for the clean below
+    actApply(actOutlets(pourOutlets));
+
+    // =====================
+    // Staged cleaning flow
+    // =====================
+    Serial.printf("[CLEAN] Beginning staged cleaning sequence (%s)\n", postClean == POST_CLEAN_FULL ? "full" : "light – repeat drink");
+
+    // Water flush (full clean only), then air purge out of the top – the POUR_CLEAN
+    // table (maint_sequence.h), on this pour's spout path(s); ends with everything off
+    MaintRun cleanRun;
+    cleanRun.spoutOuts = pourOutlets;
+    cleanRun.purgeOuts = purgeOutlets;
+    cleanRun.skip      = postClean == POST_CLEAN_FULL ? 0 : ACT_WATER;
+    cleanRun.onStep    = pourCleanStep;
+    cleanRun.tick      = pourCleanTick;
+    mseqRun(MSEQ_POUR_CLEAN, cleanRun);
+    Serial.println("[CLEAN] Staged cleaning sequence complete; pump stopped, outlets closed");
+
+    // Final 100 % frame; it is published ahead of the result below
+    pst.doneSec = pst.totalSec; pst.segSec = 0.0f;
+    progressTick(true);
+    pst.active = false;
+
+    if (faulted) {
+      cleanPolicyExpectNext(0);
+      pourReportFault(drink, count);
+    } else {
+      // Notify drink completion AFTER air purge top is complete - drink is now ready!
+      notifyPourResult(true, nullptr, drink, count, pourResultStation());
+      Serial.println("✅ Drink completion notified after air purge");
+
+      // Feed the ETA model (cup-removal pauses are the guest's, not the machine's; so is a batch cup swap)
+      unsigned long tReady = millis();
+      if (first) etaModelRecordPhase(ETA_PH_PREP, (tPrepEnd - etaT0 - rinseMs) / 1000.0f); // rinse is fixed, not learned
+      etaModelRecordPhase(ETA_PH_START, (tStartEnd - tPrepEnd) / 1000.0f);
+      if (postClean == POST_CLEAN_FULL) etaModelRecordPhase(ETA_PH_CLEAN, (tReady - tDispenseEnd) / 1000.0f);
+      etaModelRecordPour(eta, (tReady - etaT0 - pausedMs) / 1000.0f);
+
+      // Start success LED sequence AFTER water flush and top air purge
+      ledCue(LED_CUE_SUCCESS);
+    }
 
-  // Finish dispense: stop mechanics
-  pumpOff();
-  cleanupDrinkController();
-
-  // =====================
-  // Staged cleaning flow
-  // =====================
-  Serial.println("[CLEAN] Beginning staged cleaning sequence");
-
-  // Ensure all ingredient slots (1..12) are closed before cleaning
-  Serial.println("[CLEAN] Closing all ingredient slots (1..12)");
-  for (int s = 1; s <= 12; ++s) ncvSetSlot(s, false);
-
-  // Step 1: Water flush → outputs 1=ON,3=ON,2=OFF,4=OFF; open slot 13 for CLEAN_WATER_MS
-  Serial.printf("[CLEAN-1] Water flush: OUT1=ON, OUT3=ON, OUT2=OFF, OUT4=OFF; slot13=OPEN for %u ms\n", (unsigned)CLEAN_WATER_MS);
-  outletSetState(true, false, true, false);
-  pumpOn();
-  ncvSetSlot(13, true);
-  delay(CLEAN_WATER_MS);
-  ncvSetSlot(13, false);
-  Serial.println("[CLEAN-1] Water flush complete; slot13=CLOSED");
-
-  // Step 2: Air purge (top) → outputs 1=ON,3=OFF,2=OFF,4=ON; push out to spout
-  Serial.printf("[CLEAN-2] Air purge top: OUT1=ON, OUT3=OFF, OUT2=OFF, OUT4=ON for %u ms\n", (unsigned)CLEAN_AIR_TOP_MS);
-  outletSetState(true, false, false, true);
-  pumpOn();
-  delay(CLEAN_AIR_TOP_MS);
-  Serial.println("[CLEAN-2] Air purge top complete");
-
-  // Notify drink completion AFTER air purge top is complete - drink is now ready!
-  notifyPourResult(true, nullptr);
-  Serial.println("✅ Drink completion notified after air purge");
-
-  // Start success LED sequence AFTER water flush and top air purge, but don't block trash drain
-  xTaskCreatePinnedToCore(ledSuccessTask, "LedSuccess", 2048, nullptr, 1, nullptr, 1);
-
-  // Step 3: Trash drain (combined) → OUT1=OFF, OUT2=ON, OUT3=OFF, OUT4=ON; slot14=OPEN
-  Serial.printf("[CLEAN-3] Trash drain: OUT1=OFF, OUT2=ON, OUT3=OFF, OUT4=ON; slot14=OPEN for %u ms\n", (unsigned)CLEAN_TRASH_MS);
-  outletSetState(false, true, false, true);
-  pumpOn();
-  ncvSetSlot(14, true);
-  delay(CLEAN_TRASH_MS);
-  ncvSetSlot(14, false);
-  Serial.println("[CLEAN-3] Trash drain complete; slot14=CLOSED");
-
-  // Stop pump and close all outlets
-  pumpOff();
-  Serial.println("[CLEAN] Staged cleaning sequence complete; stopping pump and closing outlets");
-  outletAllOff();
+    // Step 3: Trash drain → owed to the line and run as an idle job (dcIdleService),
+    // so the device is free for the next order as soon as the drink is ready
+    if (postClean == POST_CLEAN_FULL) {
+      idleDrainLeftMs = CLEAN_TRASH_MS;
+      Serial.printf("[CLEAN-3] Trash drain (%u ms) deferred to idle\n", (unsigned)CLEAN_TRASH_MS);
+    }
+    cleanPolicyRecordPour(recipeMask, postClean);
 
-  // ---------------------
-  // Update slot volumes
-  // ---------------------
-  {
-    uint8_t maxIngr = getIngredientCountFromId();
-    float used[15] = {0};
-    for (auto &ic : parsed) {
-      if (ic.slot >= 1 && ic.slot <= maxIngr) {
-        used[ic.slot - 1] += ic.amount; // amounts are ounces
-      }
+    if (faulted) {
+      // Poured amounts are unknown: keep the stored volumes, drop this and the later reservations
+      stockRelease(parsed.items, parsed.count, count - drink + 1);
+      break;
     }
-    for (uint8_t iSlot = 0; iSlot < maxIngr && iSlot < 15; ++iSlot) {
-      if (used[iSlot] > 0.0f) {
-        useVolumeForSlot(iSlot, used[iSlot]);
+
+    // ---------------------
+    // Update slot volumes
+    // ---------------------
+    {
+      uint8_t maxIngr = getIngredientCountFromId();
+      float used[BOARD_INGREDIENT_SLOTS] = {0};
+      for (uint8_t k = 0; k < parsed.count; ++k) {
+        const IngredientCommand &ic = parsed.items[k];
+        if (ic.slot >= 1 && ic.slot <= maxIngr) {
+          used[ic.slot - 1] += ic.amount; // amounts are ounces
+        }
+      }
+      for (uint8_t iSlot = 0; iSlot < maxIngr; ++iSlot) {
+        if (used[iSlot] > 0.0f) {
+          useVolumeForSlot(iSlot, used[iSlot]);
+        }
       }
+      // Persist once after batch update
+      saveVolumesNow();
+      stockRelease(parsed.items, parsed.count, 1); // now off slotVolumes
     }
-    // Persist once after batch update
-    saveVolumesNow();
   }
 
+  pourDrinksAfter = 0;
+  idleJobNotBefore = millis() + IDLE_CLEAN_GAP_MS;
   setState(State::IDLE);
   // Ensure steady white idle after cleaning
   ledIdle();
   Serial.println("✅ Pour complete → IDLE");
-  vTaskDelete(nullptr);
 }
 
-static void ledSuccessTask(void *param) {
-  // Run success animation (green/white then back to white)
-  ledSuccess();
-  vTaskDelete(nullptr);
+// Long-lived: plays LED cues so the pour never waits on a fade.
+static void ledCueTask(void *param) {
+  uint8_t cue;
+  for (;;) {
+    if (xQueueReceive(ledQueue, &cue, portMAX_DELAY) != pdTRUE) continue;
+    if (cue == LED_CUE_FADE_RED) fadeToRed();
+    else if (cue == LED_CUE_SUCCESS) ledSuccess(); // green/white then back to white
+  }
 }
 
-/* ============================================================================================ */
-/*                                       PARSE                                                  */
-/* ============================================================================================ */
-std::vector<IngredientCommand> parseDrinkCommand(const String &commandStr) {
-  std::vector<IngredientCommand> parsed;
-  int start = 0;
-  while (true) {
-    int comma = commandStr.indexOf(',', start);
-    String seg = (comma == -1) ? commandStr.substring(start) : commandStr.substring(start, comma);
-    seg.trim();
-    if (seg.length()) {
-      int c1 = seg.indexOf(':');
-      int c2 = seg.indexOf(':', c1 + 1);
-      if (c1 != -1) {
-        IngredientCommand ic{};
-        ic.slot = seg.substring(0, c1).toInt();
-        if (c2 != -1) {
-          ic.amount   = seg.substring(c1 + 1, c2).toFloat();
-          ic.priority = seg.substring(c2 + 1).toInt();
-        } else {
-          ic.amount   = seg.substring(c1 + 1).toFloat();
-          ic.priority = 99;
-        }
-        parsed.push_back(ic);
-      }
-    }
-    if (comma == -1) break;
-    start = comma + 1;
-  }
-  return parsed;
+static bool ledCue(LedCue cue) {
+  uint8_t c = cue;
+  return ledQueue && xQueueSend(ledQueue, &c, 0) == pdTRUE;
 }
 
+
 /* ============================================================================================ */
 /*                               DISPENSE (public + helpers)                                     */
 /* ============================================================================================ */
 
-void dispenseDrink(std::vector<IngredientCommand> &parsed) {
-  if (parsed.empty()) return;
+void dispenseDrink(DrinkRecipe &parsed) {
   // Filter invalid slots
   {
-    std::vector<IngredientCommand> filtered;
-    for (auto &c : parsed) if (isValidIngredientSlot(c.slot)) filtered.push_back(c);
-    parsed.swap(filtered);
+    uint8_t kept = 0;
+    for (uint8_t k = 0; k < parsed.count; ++k) {
+      if (isValidIngredientSlot(parsed.items[k].slot)) parsed.items[kept++] = parsed.items[k];
+    }
+    parsed.count = kept;
   }
-  if (parsed.empty()) return;
-
-  // Open auxiliary outlet solenoids 1 & 3 during dispense
-  outletSolenoidSet(1, true);
-  outletSolenoidSet(3, true);
+  if (!parsed.count) return;
 
-  // Start pump
-  pumpOn();
+  // Spout A path (OUT1 + OUT3), every valve closed, pump on – one checked step
+  pourPumpPct = PUMP_SPEED_POUR;
+  if (!actApply(ACT_ROUTE_SPOUT | ACT_PUMP, pourPumpPct)) return;
 
-  std::sort(parsed.begin(), parsed.end(),
-            [](const IngredientCommand &a, const IngredientCommand &b){ return a.priority < b.priority; });
+  sortByPriority(parsed.items, parsed.count);
 
-  size_t i = 0;
-  while (i < parsed.size()) {
-    int pr = parsed[i].priority;
-    std::vector<IngredientCommand> group;
-    while (i < parsed.size() && parsed[i].priority == pr) { group.push_back(parsed[i]); ++i; }
+  uint8_t i = 0;
+  while (i < parsed.count) {
+    int pr = parsed.items[i].priority;
+    uint8_t n = priorityGroupLength(parsed.items + i, parsed.count - i);
     Serial.printf("\n>> Priority %d group <<\n", pr);
-    dispenseParallelGroup(group);
+    dispenseParallelGroup(parsed.items + i, n);
+    i += n;
   }
 
-  pumpOff();
-
-  // Close auxiliary outlet solenoids after dispense
-  outletSolenoidSet(1, false);
-  outletSolenoidSet(3, false);
-  outletAllOff();
+  // Pump, valves and outlets off
+  actApply(0);
 }
 
-static void dispenseParallelGroup(std::vector<IngredientCommand> &group, bool overrideNoCup) {
-  std::vector<PourState> pours;
-  for (auto &ic : group) {
+// Returns the time (ms) the group spent paused for a removed cup.
+static uint32_t dispenseParallelGroup(const IngredientCommand *group, size_t n, bool overrideNoCup) {
+  IngredientCommand pours[PLAN_MAX_SLOTS];
+  size_t nPours = 0;
+  for (size_t k = 0; k < n; ++k) {
+    const IngredientCommand &ic = group[k];
     if (!isValidIngredientSlot(ic.slot)) continue; // safe
-    if (ic.slot == 13 || ic.slot == 14) {
+    if (ic.slot == BOARD_SLOT_WATER || ic.slot == BOARD_SLOT_AIR) {
       // Don't allow specials during pour scheduling
       Serial.printf("[WARN] Ignoring special slot %d during pour; reserved for cleaning.\n", ic.slot);
       continue;
     }
-    pours.push_back({ ic.slot, ic.amount, false });
+    if (nPours < PLAN_MAX_SLOTS) pours[nPours++] = ic;
+  }
+  if (nPours == 0) return 0;
+
+  static PourPlan plan; // only one pour task runs at a time
+  static float gramsAtEvent[PLAN_MAX_EVENTS];
+  bool  gravimetric = !overrideNoCup && !pourStation && pressurePadWeightReady(); // pad B only senses presence
+  if (planLock) xSemaphoreTake(planLock, portMAX_DELAY);
+  flowModelRefresh();
+  flowModelUpdateFill(pours, nPours); // head pressure from tracked bottle volumes
+  // Planned at the regulated pump speed; the timeline applies it as valves open and close
+  bool planned = planGroupMinMakespan(pours, nPours, flowModelPourRate, plan);
+  // Closed loop on measured mass when the pad can weigh (needs the cup on it)
+  if (planned && gravimetric) planMassProfile(plan, flowModelPourRate, flowModelGramsPerOz, gramsAtEvent);
+  if (planLock) xSemaphoreGive(planLock);
+  if (!planned) {
+    Serial.println("[POUR] Planner rejected group – nothing poured");
+    return 0;
   }
-  if (pours.empty()) return;
+  // Log the plan BEFORE starting so serial output never delays a valve
+  Serial.printf("[PLAN] %u valves, max %u open, makespan %.3f s\n", (unsigned)nPours,
+                (unsigned)plan.maxOpen, plan.makespanUs / 1e6f);
+  for (uint8_t e = 0; e < plan.count; ++e) {
+    Serial.printf("   [PLAN] t=%8.3f ms  slot %2u %s\n", plan.events[e].atUs / 1000.0f,
+                  (unsigned)plan.events[e].slot, plan.events[e].open ? "OPEN" : "CLOSE");
+  }
+
+  float groupStartG = gravimetric ? pressurePadGrams() : 0.0f;
+  uint32_t groupMask = cleanPolicyMask(pours, nPours);
 
-  const unsigned long stepMs  = 50;  // scheduler tick
-  const float         stepSec = 0.05f;
   bool pauseAlertSent = false; // ensure we only notify the app once per pause
+  uint32_t pausedMs = 0;
+  unsigned long groupStart = millis();
+  ulTaskNotifyTake(pdTRUE, 0); // drop a completion left over from the previous group/pour
+  timelineStart(plan);
+  progressPhase(PH_POUR, etaModelGroupSec(plan.makespanUs / 1e6f), pst.group + 1); // after start: tlRun is this plan
+  while (!tlRun.finished) {
+    // Woken by the timer on completion; otherwise poll the cup every 20 ms
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+    if (tlRun.finished) break;
+    // Diagnostics ride on the timeline's own frames (a trip wakes us early);
+    // this only reads the decoded masks. An overloaded channel is already off –
+    // stop the rest of the drink.
+    if (pourValveFault(ncvFaulted() & groupMask)) {
+      timelinePause();
+      actApply(dcActuators() & ~ACT_PUMP);
+      break;
+    }
+    progressTick();
+    if (gravimetric && isCupPresent()) timelineWarpToMass(gramsAtEvent, pressurePadGrams() - groupStartG);
 
-  while (true) {
     // Pause/resume safety: if cup removed, STOP pump, keep solenoids as-is, and wait
-    if (!overrideNoCup && !isCupPresent()) {
+    if (!overrideNoCup && !pourCupPresent()) {
       // Immediately stop pump to prevent spillage; leave valves as they are
-      pumpOff();
+      timelinePause();
+      actApply(dcActuators() & ~ACT_PUMP);
+      unsigned long pauseStart = millis();
       Serial.println("[SAFETY] Cup removed – pausing pour until return...");
       // Notify app once per pause using existing status/error formatting
       if (!pauseAlertSent) {
-  JsonDocument doc;
-        doc["status"] = "fail";
-        doc["error"]  = "Glass Removed - replace glass to continue";
-        String out; serializeJson(doc, out);
-        sendData(AWS_RECEIVE_TOPIC, out);
+        publishDeferred(AWS_RECEIVE_TOPIC, "{\"status\":\"fail\",\"error\":\"Glass Removed - replace glass to continue\"}");
         pauseAlertSent = true;
       }
       // Flash LED red while waiting
-      while (!isCupPresent()) {
+      pst.paused = true;
+      progressTick(true);
+      while (!pourCupPresent()) {
         ledFlashRedQuick();
         delay(120);
+        progressTick();
       }
+      pst.paused = false;
       Serial.println("[SAFETY] Cup returned – resuming pour.");
       // Back to solid red and resume pump
       fadeToRed();
-      pumpOn();
+      if (!actApply(dcActuators() | ACT_PUMP, pourPumpPct)) {
+        pourRefused = true;   // pump stays off: stop the drink
+        break;
+      }
+      timelineResume();
+      pausedMs += millis() - pauseStart;
       pauseAlertSent = false; // allow future pauses to alert again
     }
-    int openCnt = 0; float needSum = 0.0f;
-    for (auto &p : pours) if (!p.done && p.ouncesLeft > 0.0f) { openCnt++; needSum += p.ouncesLeft; }
-    if (openCnt == 0) break;
-
-    // Open the active slots, close others
-    for (auto &p : pours) ncvSetSlot(p.slot, (!p.done && p.ouncesLeft > 0.0f));
-
-    // Distribute flow proportionally
-    float totalFlow = flowRate(openCnt);
-    if (totalFlow <= 0.0f) totalFlow = 0.68f; // safety default for many‑open case
-    for (auto &p : pours) {
-      if (p.done || p.ouncesLeft <= 0.0f) continue;
-      float frac   = p.ouncesLeft / needSum;
-      float dispOz = totalFlow * frac * stepSec;
-      p.ouncesLeft -= dispOz;
-      if (p.ouncesLeft <= 0.0f) { p.ouncesLeft = 0.0f; p.done = true; ncvSetSlot(p.slot, false); }
+  }
+  if (!pourFaultSlot && !pourRefused) etaModelRecordGroup(plan.makespanUs / 1e6f, (millis() - groupStart - pausedMs) / 1000.0f);
+
+  // Ensure the group's valves are off; the pump keeps its state for the next group
+  ActuatorMask groupOff = dcActuators();
+  for (size_t k = 0; k < nPours; ++k) groupOff &= ~actSlot(pours[k].slot);
+  actApply(groupOff, pourPumpPct);
+  if (gravimetric) {
+    Serial.printf("[GRAV] Group mass: expected %.1f g, measured %.1f g\n",
+                  gramsAtEvent[plan.count - 1], pressurePadGrams() - groupStartG);
+  }
+  return pausedMs;
+}
+
+/* ------------------------------- VALVE TIMELINE ------------------------------- */
+static void timelineSetup() {
+  if (tlTimer) return;
+  esp_timer_create_args_t args = {};
+  args.callback        = timelineTimerCb;
+  args.arg             = nullptr;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name            = "valveTimeline";
+  if (esp_timer_create(&args, &tlTimer) != ESP_OK) {
+    tlTimer = nullptr;
+    Serial.println("❌ esp_timer_create failed (valve timeline)");
+  }
+}
+
+// Runs in the esp_timer task. Applies every event that is due as ONE SPI write.
+static void timelineTimerCb(void *arg) {
+  portENTER_CRITICAL(&tlMux);
+  if (tlRun.paused || !tlRun.plan) { portEXIT_CRITICAL(&tlMux); return; }
+  const PourPlan &plan = *tlRun.plan;
+  int64_t elapsed = esp_timer_get_time() - tlRun.startUs;
+  uint8_t first = tlRun.next, last = first;
+  while (last < plan.count && (int64_t)plan.events[last].atUs <= elapsed + TL_SLACK_US) ++last;
+  tlRun.next = last;
+  portEXIT_CRITICAL(&tlMux);
+
+  uint8_t open = tlRun.open;
+  ncvBegin();
+  for (uint8_t e = first; e < last; ++e) {
+    if (plan.events[e].open) ++open; else if (open) --open;
+    ncvSetSlot(plan.events[e].slot, plan.events[e].open);
+  }
+  ncvCommit();
+  tlRun.open = open;
+  // Pump speed follows the open-valve count the plan was timed with
+  if (open && !tlRun.paused) {
+    uint8_t pct = flowModelPumpPct(open);
+    if (pct != pourPumpPct) {
+      pourPumpPct = pct;
+      pumpOn(pct);
+    }
+  }
+
+  if (last >= plan.count) {
+    tlRun.finished = true;
+    if (tlRun.waiter) xTaskNotifyGive(tlRun.waiter);
+    return;
+  }
+  timelineArmNext();
+}
+
+static void timelineArmNext() {
+  portENTER_CRITICAL(&tlMux);
+  bool ok = !tlRun.paused && tlRun.plan && tlRun.next < tlRun.plan->count;
+  int64_t dueUs = ok ? tlRun.startUs + tlRun.plan->events[tlRun.next].atUs - esp_timer_get_time() : 0;
+  portEXIT_CRITICAL(&tlMux);
+  if (!ok || !tlTimer) return;
+  if (dueUs < 0) dueUs = 0;
+  esp_timer_stop(tlTimer); // re-arm if a warp moved the next event
+  esp_timer_start_once(tlTimer, (uint64_t)dueUs);
+}
+
+static void timelineStart(const PourPlan &plan) {
+  portENTER_CRITICAL(&tlMux);
+  tlRun.plan       = &plan;
+  tlRun.next       = 0;
+  tlRun.open       = 0;
+  tlRun.paused     = false;
+  tlRun.finished   = (plan.count == 0);
+  tlRun.waiter     = xTaskGetCurrentTaskHandle();
+  tlRun.startUs    = esp_timer_get_time();
+  tlRun.baseStartUs = tlRun.startUs;
+  portEXIT_CRITICAL(&tlMux);
+  if (tlRun.finished) return;
+  if (!tlTimer) {
+    // No timer available: fire inline (t=0 events) and fall back to coarse waits
+    Serial.println("[POUR] Timeline timer missing – firing events from pour task");
+    while (!tlRun.finished) {
+      timelineTimerCb(nullptr);
+      if (!tlRun.finished) vTaskDelay(1);
     }
+    return;
+  }
+  timelineTimerCb(nullptr); // t=0 opens go out immediately, then the timer takes over
+  int64_t debtUs = pumpRampDebtUs();
+  if (debtUs > 0) {
+    // Pump still soft-starting: the rest of the plan runs late by the flow the ramp owes
+    portENTER_CRITICAL(&tlMux);
+    tlRun.startUs     += debtUs;
+    tlRun.baseStartUs += debtUs;
+    portEXIT_CRITICAL(&tlMux);
+    timelineArmNext();
+  }
+}
+
+static void timelinePause() {
+  if (tlTimer) esp_timer_stop(tlTimer);
+  portENTER_CRITICAL(&tlMux);
+  if (!tlRun.paused) {
+    tlRun.paused = true;
+    tlRun.pausedAtUs = esp_timer_get_time();
+  }
+  portEXIT_CRITICAL(&tlMux);
+}
+
+static void timelineResume() {
+  portENTER_CRITICAL(&tlMux);
+  if (tlRun.paused) {
+    int64_t pausedUs = esp_timer_get_time() - tlRun.pausedAtUs + pumpRampDebtUs();
+    tlRun.startUs     += pausedUs; // pump was off: shift remaining events
+    tlRun.baseStartUs += pausedUs;
+    tlRun.paused = false;
+  }
+  portEXIT_CRITICAL(&tlMux);
+  timelineArmNext();
+}
+
+// Closed loop: move plan time to where the measured mass says the pour really is
+static void timelineWarpToMass(const float *gramsAtEvent, float measuredG) {
+  if (measuredG < GRAV_MIN_GRAMS || !tlRun.plan) return;
+  int64_t tau = (int64_t)planTimeForMass(*tlRun.plan, gramsAtEvent, measuredG) + GRAV_LAG_MS * 1000LL;
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&tlMux);
+  if (tlRun.paused || tlRun.finished) { portEXIT_CRITICAL(&tlMux); return; }
+  int64_t wall = now - tlRun.baseStartUs;
+  int64_t lo = (int64_t)(wall * GRAV_RATE_MIN), hi = (int64_t)(wall * GRAV_RATE_MAX);
+  if (tau < lo) tau = lo;
+  if (tau > hi) tau = hi;
+  tlRun.startUs = now - tau;
+  portEXIT_CRITICAL(&tlMux);
+  timelineArmNext();
+}
 
-  delay(stepMs);
+/* ------------------------------- PROGRESS FRAMES ------------------------------ */
+static void progressBegin(float totalSec, uint8_t groups, uint8_t hz) {
+  pst = {};
+  pst.active   = hz > 0;
+  pst.totalSec = totalSec > 0.01f ? totalSec : 0.01f;
+  pst.groups   = groups;
+  pst.periodMs = hz ? (uint16_t)(1000 / hz) : 0;
+}
+
+// Finish the current segment and start the next one; always emits a frame.
+static void progressPhase(PourPhase phase, float segSec, uint8_t group) {
+  if (!pst.active) return;
+  pst.doneSec   += pst.segSec;
+  pst.phase      = phase;
+  pst.segSec     = segSec;
+  pst.segStartMs = millis();
+  if (group) pst.group = group;
+  progressTick(true);
+}
+
+// Position inside the current segment: plan time for pour groups (follows warps
+// and pauses), wall time for the fixed phases. Emits at most one frame per periodMs.
+static void progressTick(bool force) {
+  if (!pst.active) return;
+  unsigned long nowMs = millis();
+  if (!force && (nowMs - pst.lastFrameMs) < pst.periodMs) return;
+  pst.lastFrameMs = nowMs;
+
+  float frac = 0.0f;
+  if (pst.phase == PH_POUR && tlRun.plan) {
+    portENTER_CRITICAL(&tlMux);
+    int64_t at = (tlRun.paused ? tlRun.pausedAtUs : esp_timer_get_time()) - tlRun.startUs;
+    uint32_t span = tlRun.plan->makespanUs;
+    portEXIT_CRITICAL(&tlMux);
+    if (span > 0) frac = (float)at / (float)span;
+  } else if (pst.segSec > 0.0f) {
+    frac = (nowMs - pst.segStartMs) / (pst.segSec * 1000.0f);
+  }
+  if (frac < 0.0f) frac = 0.0f;
+  if (frac > 0.99f) frac = 0.99f; // the segment is only done when the task moves on
+
+  float done = pst.doneSec + frac * pst.segSec;
+  float pct  = 100.0f * done / pst.totalSec;
+  if (pct > 99.0f && pst.segSec > 0.0f) pct = 99.0f; // 100 only once the drink is ready
+  if (pct > 100.0f) pct = 100.0f;
+  PourProgress p;
+  p.percent     = (uint8_t)pct;
+  p.phase       = POUR_PHASE_NAMES[pst.phase];
+  p.group       = pst.phase == PH_POUR ? pst.group : 0;
+  p.groups      = pst.groups;
+  p.secondsLeft = pst.totalSec > done ? pst.totalSec - done : 0.0f;
+  p.paused      = pst.paused;
+  notifyPourProgress(p);
+}
+
+// delay() that keeps progress frames flowing.
+static void progressSleep(uint32_t ms) {
+  unsigned long start = millis();
+  while ((millis() - start) < ms) {
+    uint32_t left = ms - (millis() - start);
+    vTaskDelay(pdMS_TO_TICKS(left > 50 ? 50 : left));
+    progressTick();
   }
+}
 
-  for (auto &p : pours) ncvSetSlot(p.slot, false); // ensure off
+// Post-pour clean steps: each gets its share of the learned clean time
+static void pourCleanStep(const MaintStep &st) {
+  uint32_t full = std::max<uint32_t>(1, mseqDurationMs(MSEQ_POUR_CLEAN));
+  progressPhase((st.mask & ACT_WATER) ? PH_FLUSH : PH_PURGE, etaModelPhaseSec(ETA_PH_CLEAN) * st.ms / full);
 }
 
+static void pourCleanTick() { progressTick(); }
+
 /* ============================================================================================ */
 /*                                     SUPPORT / HELPERS                                        */
 /* ============================================================================================ */
-static float estimatePourTime(const std::vector<IngredientCommand> &parsed) {
-  auto v = parsed;
-  std::sort(v.begin(), v.end(), [](const IngredientCommand &a, const IngredientCommand &b){ return a.priority < b.priority; });
-  float totalSec = 0.0f; size_t i = 0;
-  while (i < v.size()) {
-    int pr = v[i].priority; float groupSumOz = 0.0f; int count = 0;
-    while (i < v.size() && v[i].priority == pr) { groupSumOz += v[i].amount; count++; i++; }
-    float rate = flowRate(count); if (rate > 0.0f) totalSec += groupSumOz / rate;
-  }
-  // Include complete cleaning cycle timing: water flush + air purge top + trash drain + latencies
-  float cleaningTime = (CLEAN_WATER_MS + CLEAN_AIR_TOP_MS) / 1000.0f;
-  return totalSec + cleaningTime; // cleaning time + extra latency buffer
-}
-
-static float flowRate(int n) {
-  // Cached calibration with versioned hot-reload
-  static bool loaded = false;
-  static uint32_t lastVer = 0;
-  static float ratesLps[5] = {0};
-  static int rateCount = 0;
-  static char fitType[8] = "";
-  static float a = 0, b = 0;
-
-  uint32_t ver = getCalibrationVersion();
-  if (!loaded || ver != lastVer) {
-    if (loadFlowCalibrationFromNVS(ratesLps, rateCount, fitType, a, b)) {
-      loaded = true;
-      lastVer = ver;
+// Planner makespan per group, corrected by the learned ETA model (eta_model.h).
+// plannedSec (optional) receives the raw summed makespan.
+static float estimatePourTime(const IngredientCommand *cmds, size_t n, float *plannedSec) {
+  IngredientCommand v[DRINK_MAX_ITEMS];
+  if (n > DRINK_MAX_ITEMS) n = DRINK_MAX_ITEMS;
+  memcpy(v, cmds, n * sizeof(IngredientCommand));
+  sortByPriority(v, (uint8_t)n);
+  // Same timeline the pour executes: sum of each group's planned makespan
+  float totalSec = 0.0f; size_t i = 0; uint8_t groups = 0;
+  PourPlan plan;
+  if (planLock) xSemaphoreTake(planLock, portMAX_DELAY);
+  flowModelRefresh();
+  while (i < n) {
+    int pr = v[i].priority;
+    IngredientCommand group[PLAN_MAX_SLOTS]; size_t count = 0;
+    while (i < n && v[i].priority == pr) {
+      if (v[i].slot != BOARD_SLOT_WATER && v[i].slot != BOARD_SLOT_AIR && count < PLAN_MAX_SLOTS) group[count++] = v[i];
+      i++;
     }
+    flowModelUpdateFill(group, count);
+    if (planGroupMinMakespan(group, count, flowModelPourRate, plan)) { totalSec += plan.makespanUs / 1e6f; ++groups; }
   }
+  if (planLock) xSemaphoreGive(planLock);
+  if (plannedSec) *plannedSec = totalSec;
+  // Learned offsets cover cup wait, LED fade, pressurisation and the clean up to the result;
+  // the cleaning policy decides whether a rinse comes first and how much clean follows
+  uint32_t mask = cleanPolicyMask(v, n);
+  float rinseSec = cleanPolicyNeedsRinse(mask) ? RINSE_MS / 1000.0f : idleDrainLeftMs / 1000.0f;
+  return etaModelPredict(totalSec, groups, cleanPolicyAfterPour(mask) == POST_CLEAN_LIGHT) + rinseSec;
+}
 
-  // Prefer discrete rates and clamp 6+ to the 5th value when present
-  if (loaded && rateCount > 0) {
-    if (n <= 0) n = 1;
-    int idx = n;
-    if (idx > 5) idx = 5;
-    if (idx > rateCount) idx = rateCount;
-    float lps = ratesLps[idx - 1];
-    if (lps > 0.0f) return lps * 33.814f; // L/s → oz/s
-    // If somehow zero, fall through to fit/default
-  }
-  // If no discrete rates available, try fit (optional)
-  if (loaded && n > 0) {
-    if (strcmp(fitType, "log") == 0) {
-      float lps = a + b * logf((float)n);
-      if (lps < 0.01f) lps = 0.01f;
-      return lps * 33.814f;
-    } else if (strcmp(fitType, "linear") == 0) {
-      float lps = a + b * n;
-      if (lps < 0.01f) lps = 0.01f;
-      return lps * 33.814f;
+// True if the tracked volumes cover every ingredient of the recipe.
+static bool checkStock(const IngredientCommand *cmds, size_t n, bool verbose, uint8_t count) {
+  uint8_t maxIngr = getIngredientCountFromId();
+  float needOz[BOARD_INGREDIENT_SLOTS] = {0};
+  for (size_t k = 0; k < n; ++k) {
+    const IngredientCommand &ic = cmds[k];
+    if (ic.slot >= 1 && ic.slot <= maxIngr) {
+      needOz[ic.slot - 1] += ic.amount * count;
+    }
+  }
+  bool sufficient = true;
+  for (uint8_t i = 0; i < maxIngr; ++i) {
+    if (needOz[i] <= 0) continue;
+    float needL = needOz[i] / 33.814f;
+    portENTER_CRITICAL(&stockMux);
+    float heldL = heldOz[i] / 33.814f;
+    portEXIT_CRITICAL(&stockMux);
+    float haveL = getVolumeLitersForSlot(i) - heldL; // minus what accepted orders will take
+    if (haveL + 1e-6f < needL) { // small epsilon
+      sufficient = false;
+      if (verbose) Serial.printf("[STOCK] Slot %u needs %.3f L but has %.3f L — insufficient.\n", (unsigned)(i+1), needL, haveL);
     }
   }
-  // Fallback to legacy hardcoded oz/s
-  switch (n) {
-    case 1: return 0.38f;
-    case 2: return 0.54f;
-    case 3: return 0.61f;
-    case 4: return 0.65f;
-    default: return 0.68f; // 5+
+  return sufficient;
+}
+
+// Recipe string → commands on slots this device has, with something to pour.
+// Commands the pour task would see differently – longer than its ORDER_CMD_MAX copy,
+// or more entries than DRINK_MAX_ITEMS – are invalid, not cut short.
+static bool parseValid(const char *commandStr, DrinkRecipe &out) {
+  out.count = 0;
+  if (!commandStr || strlen(commandStr) >= ORDER_CMD_MAX) return false;
+  if (!parseDrinkCommand(commandStr, out)) { out.count = 0; return false; }
+  uint8_t kept = 0;
+  for (uint8_t k = 0; k < out.count; ++k) {
+    const IngredientCommand &c = out.items[k];
+    if (isValidIngredientSlot(c.slot) && c.amount > 0.0f) out.items[kept++] = c;
+  }
+  out.count = kept;
+  return kept > 0;
+}
+
+float estimateDrinkTime(const char *commandStr, bool *inStock) {
+  DrinkRecipe r;
+  if (inStock) *inStock = false;
+  if (!parseValid(commandStr, r)) return -1.0f;
+  if (inStock) *inStock = checkStock(r.items, r.count, false);
+  return estimatePourTime(r.items, r.count);
+}
+
+// Drinks in a batch as poured, reserved and released: 1..POUR_BATCH_MAX
+static uint8_t batchCount(uint8_t count) {
+  return count < 1 ? 1 : (count > POUR_BATCH_MAX ? POUR_BATCH_MAX : count);
+}
+
+int dcReserveStock(const char *commandStr, uint8_t count) {
+  count = batchCount(count);
+  DrinkRecipe r;
+  if (!parseValid(commandStr, r)) return -1;
+  if (!checkStock(r.items, r.count, true, count)) return 0;
+  // Only the MQTT loop reserves, so nothing can take the stock between check and hold
+  portENTER_CRITICAL(&stockMux);
+  for (uint8_t k = 0; k < r.count; ++k) {
+    const IngredientCommand &c = r.items[k];
+    if (c.slot >= 1 && c.slot <= BOARD_INGREDIENT_SLOTS) heldOz[c.slot - 1] += c.amount * count;
+  }
+  portEXIT_CRITICAL(&stockMux);
+  return 1;
+}
+
+void dcReleaseStock(const char *commandStr, uint8_t count) {
+  count = batchCount(count);
+  DrinkRecipe r;
+  if (parseValid(commandStr, r)) stockRelease(r.items, r.count, count);
+}
+
+// Records the lowest faulted slot of the mask as the drink's fault; true if any.
+static bool pourValveFault(uint32_t faulted) {
+  if (!faulted) return false;
+  if (!pourFaultSlot) {
+    uint8_t s = 1;
+    while (!(faulted & 1ul)) { faulted >>= 1; ++s; }
+    pourFaultSlot     = s;
+    pourFaultOverload = (ncvOverMask >> (s - 1)) & 1ul;
   }
+  return true;
+}
+
+static void pourReportFault(uint8_t drink, uint8_t count) {
+  if (pourRefused) {
+    Serial.println("❌ [ACT] Pour target refused by the interlocks – pour stopped");
+    notifyPourResult(false, "interlock", drink, count, pourResultStation());
+    return;
+  }
+  const char *kind = pourFaultOverload ? "overload" : "open_load";
+  Serial.printf("❌ [NCV] Slot %u %s – pour stopped\n", (unsigned)pourFaultSlot, kind);
+  char msg[80];
+  snprintf(msg, sizeof(msg), "{\"status\":\"valve_fault\",\"slot\":%u,\"fault\":\"%s\"}", (unsigned)pourFaultSlot, kind);
+  publishDeferred(AWS_RECEIVE_TOPIC, msg);
+  const char *err = pourFaultOverload ? "valve_overload" : "valve_open_load";
+  notifyPourResult(false, err, drink, count, pourResultStation());
+}
+
+static void stockRelease(const IngredientCommand *cmds, size_t n, uint8_t count) {
+  portENTER_CRITICAL(&stockMux);
+  for (size_t k = 0; k < n; ++k) {
+    const IngredientCommand &c = cmds[k];
+    if (c.slot < 1 || c.slot > BOARD_INGREDIENT_SLOTS || c.amount <= 0.0f) continue;
+    float &h = heldOz[c.slot - 1];
+    h -= c.amount * count;
+    if (h < 0.0f) h = 0.0f;
+  }
+  portEXIT_CRITICAL(&stockMux);
+}
+
+float dcPourSecondsLeft() {
+  if (getCurrentState() != State::POURING) return 0.0f;
+  long msLeft = (long)(pourDrinkEndMs - millis());
+  float sec = msLeft > 0 ? msLeft / 1000.0f : 0.0f;
+  return sec + pourDrinksAfter * pourDrinkSec;
 }
 
 static uint8_t getIngredientCountFromId() {
 #ifdef LIQUORBOT_ID
   if (LIQUORBOT_ID && isdigit(LIQUORBOT_ID[0]) && isdigit(LIQUORBOT_ID[1])) {
     int n = (LIQUORBOT_ID[0]-'0')*10 + (LIQUORBOT_ID[1]-'0');
-    if (n < 0) n = 0; if (n > 12) n = 12; // clamp to HW
+    if (n < 0) n = 0; if (n > BOARD_INGREDIENT_SLOTS) n = BOARD_INGREDIENT_SLOTS; // clamp to HW
     return (uint8_t)n;
   }
 #endif
-  return 12; // default
+  return BOARD_INGREDIENT_SLOTS; // default
 }
 
 static bool isValidIngredientSlot(int slot) {
-  if (slot == 13 || slot == 14) return true;        // water / trash‑air
+  if (slot == BOARD_SLOT_WATER || slot == BOARD_SLOT_AIR) return true; // water / trash‑air
   uint8_t maxIngr = getIngredientCountFromId();
   return (slot >= 1 && slot <= maxIngr);
 }
 
-/* ------------------------------- PUMP (DRV8870) -------------------------------- */
+/* ------------------------------- PUMP (MOSFET, LEDC PWM) ----------------------- */
 static void pumpSetup() {
-  pinMode(PUMP_MOSFET_PIN, OUTPUT);
-  digitalWrite(PUMP_MOSFET_PIN, LOW); // Ensure pump is off at boot
+  ledc_timer_config_t tc = {};
+  tc.speed_mode      = LEDC_LOW_SPEED_MODE;
+  tc.duty_resolution = (ledc_timer_bit_t)PUMP_PWM_RES_BITS;
+  tc.timer_num       = LEDC_TIMER_0;
+  tc.freq_hz         = PUMP_PWM_FREQ_HZ;
+  tc.clk_cfg         = LEDC_AUTO_CLK;
+  ledc_timer_config(&tc);
+  ledc_channel_config_t cc = {};
+  cc.gpio_num   = PUMP_MOSFET_PIN;
+  cc.speed_mode = LEDC_LOW_SPEED_MODE;
+  cc.channel    = (ledc_channel_t)PUMP_PWM_CHANNEL;
+  cc.timer_sel  = LEDC_TIMER_0;
+  cc.duty       = 0; // Ensure pump is off at boot
+  cc.hpoint     = 0;
+  ledc_channel_config(&cc);
+
+  esp_timer_create_args_t args = {};
+  args.callback        = pumpRampCb;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name            = "pumpRamp";
+  if (esp_timer_create(&args, &pumpRampTimer) != ESP_OK) pumpRampTimer = nullptr; // no ramp: steps jump
+}
+
+// Caller holds pumpMux, so a ramp step can never land after pumpOff()
+static inline void pumpWriteDuty(uint32_t duty) {
+  pumpDutyNow = duty;
+  ledc_set_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)PUMP_PWM_CHANNEL, duty);
+  ledc_update_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)PUMP_PWM_CHANNEL);
 }
 
-static void pumpOn() {
-  digitalWrite(PUMP_MOSFET_PIN, HIGH); // Turn pump ON
+// esp_timer task: one step towards the setpoint, re-armed until it is reached
+static void pumpRampCb(void *arg) {
+  portENTER_CRITICAL(&pumpMux);
+  uint32_t d = pumpDutyNow, t = pumpDutyTarget;
+  if (d < t) d = (t - d > pumpDutyStep) ? d + pumpDutyStep : t;
+  else       d = (d - t > pumpDutyStep) ? d - pumpDutyStep : t;
+  pumpWriteDuty(d);
+  portEXIT_CRITICAL(&pumpMux);
+  if (d != t) esp_timer_start_once(pumpRampTimer, PUMP_RAMP_STEP_MS * 1000ULL);
+}
+
+// Move to pct (% duty) over ms: a soft-start when the pump is off, a slew while it runs.
+static void pumpRampTo(uint8_t pct, uint32_t ms) {
+  if (pct > 100) pct = 100;
+  uint32_t target = PUMP_DUTY_MAX * pct / 100;
+  if (pumpRampTimer) esp_timer_stop(pumpRampTimer);
+  portENTER_CRITICAL(&pumpMux);
+  uint32_t span = target > pumpDutyNow ? target - pumpDutyNow : pumpDutyNow - target;
+  uint32_t steps = ms / PUMP_RAMP_STEP_MS;
+  pumpDutyTarget = target;
+  pumpDutyStep   = steps ? std::max<uint32_t>(1, span / steps) : span;
+  bool ramp = pumpRampTimer && steps && span > pumpDutyStep;
+  if (!ramp) pumpWriteDuty(target);
+  portEXIT_CRITICAL(&pumpMux);
+  if (ramp) esp_timer_start_once(pumpRampTimer, PUMP_RAMP_STEP_MS * 1000ULL);
+}
+
+static void pumpOn(uint8_t pct) {
+  if (pumpDutyTarget == 0) {
+    pumpRampEndUs = esp_timer_get_time() + PUMP_RAMP_MS * 1000LL;
+    pumpRampTo(pct, PUMP_RAMP_MS);  // soft-start
+  } else {
+    pumpRampTo(pct, PUMP_SLEW_MS);  // already running: new phase speed
+  }
 }
 
 static void pumpOff() {
-  digitalWrite(PUMP_MOSFET_PIN, LOW); // Turn pump OFF
+  if (pumpRampTimer) esp_timer_stop(pumpRampTimer);
+  portENTER_CRITICAL(&pumpMux);
+  pumpDutyTarget = 0;
+  pumpWriteDuty(0); // no ramp down: stop now (cup removed, end of phase)
+  portEXIT_CRITICAL(&pumpMux);
+}
+
+// Plan time a soft-start still owes: the linear ramp delivers half the flow while it runs
+static int64_t pumpRampDebtUs() {
+  int64_t left = pumpRampEndUs - esp_timer_get_time();
+  return left > 0 ? left / 2 : 0;
 }
 
 /* ------------------------------- NCV7240 SPI ----------------------------------- */
 static void ncvSetup() {
+  ncvLock = xSemaphoreCreateRecursiveMutexStatic(&ncvLockBuf);
+  // IDF SPI master: Mode 1, MSB first, CS driven by the peripheral, DMA for the frame
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num     = SPI_MOSI;
+  bus.miso_io_num     = SPI_MISO;
+  bus.sclk_io_num     = SPI_SCK;
+  bus.quadwp_io_num   = -1;
+  bus.quadhd_io_num   = -1;
+  bus.max_transfer_sz = sizeof(ncvTx);
+  spi_device_interface_config_t dev = {};
+  dev.mode             = 1;
+  dev.clock_speed_hz   = NCV_SPI_HZ;
+  dev.spics_io_num     = SPI_CS;
+  dev.cs_ena_posttrans = 1;   // hold CS one bit time after the last edge
+  dev.queue_size       = 1;
+  if (spi_bus_initialize(NCV_SPI_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK ||
+      spi_bus_add_device(NCV_SPI_HOST, &dev, &ncvDev) != ESP_OK) {
+    ncvDev = nullptr;
+    Serial.println("❌ SPI master init failed (NCV7240 chain)");
+  }
+  // Only fitted lines are diagnosed – an empty channel always reads open load
+  ncvFitted = ((1ul << getIngredientCountFromId()) - 1) | (1ul << (BOARD_SLOT_WATER - 1)) | (1ul << (BOARD_SLOT_AIR - 1));
   // Baseline: all OFF
-  ncvWord[0] = 0xFFFF;
-  ncvWord[1] = 0xFFFF;
-  ncvWriteBoth();
+  ncvBegin();
+  for (uint8_t c = 0; c < BOARD_NCV_CHIPS; ++c) ncvWord[c] = 0xFFFF;
+  ncvDirty = true;
+  ncvCommit();
+}
+
+// Start a batch: slot changes only update the shadow words until the matching ncvCommit().
+// Never hold a transaction across a wait – other writers block on it.
+static void ncvBegin() {
+  if (ncvLock) xSemaphoreTakeRecursive(ncvLock, portMAX_DELAY);
+  ++ncvTxnDepth;
+}
+
+// End a batch; the outermost commit sends one frame if anything changed.
+static void ncvCommit() {
+  if (ncvTxnDepth && --ncvTxnDepth == 0 && ncvDirty) {
+    ncvDirty = false;
+    ncvWriteChain();
+  }
+  if (ncvLock) xSemaphoreGiveRecursive(ncvLock);
 }
 
 static inline void ncvSetPair(uint16_t &word, uint8_t ch, uint8_t cmd) {
@@ -623,35 +1352,214 @@ static inline void ncvSetPair(uint16_t &word, uint8_t ch, uint8_t cmd) {
   word = (word & ~mask) | ((uint16_t)cmd << shift);
 }
 
+static bool ncvSlotToChannel(int slot, uint8_t &chip, uint8_t &ch) {
+  if (slot < 1 || slot > BOARD_SPI_SLOTS) return false;
+  chip = BOARD_NCV_LINES[slot - 1].chip;      // 0 = NEAR
+  ch   = BOARD_NCV_LINES[slot - 1].ch;
+  return true;
+}
+
+// Outside a transaction this is a one-change transaction (one frame).
 static void ncvSetSlot(int slot, bool on) {
-  if (slot < 1 || slot > 16) return;
-  uint8_t chip = (slot <= 6) ? 0 : 1;        // 0=NEAR (1-6), 1=FAR (7-14)
-  uint8_t ch   = (slot <= 6) ? slot : (slot - 6); // Map 7-14 to channels 1-8 on FAR chip
+  uint8_t chip, ch;
+  if (!ncvSlotToChannel(slot, chip, ch)) return;
+  ncvBegin();
+  uint16_t before = ncvWord[chip];
   ncvSetPair(ncvWord[chip], ch, on ? NCV_CMD_ON : NCV_CMD_OFF);
-  ncvWriteBoth();
+  ncvDirty |= (ncvWord[chip] != before);
+  ncvCommit();
+}
+
+// Water then air through the shared path, out to trash (OUT2 + OUT4) – safe with a cup on the pad.
+static void rinseLineToTrash() {
+  Serial.printf("[CLEAN] Rinse to trash: water %u ms, air %u ms\n", (unsigned)CLEAN_WATER_MS, (unsigned)CLEAN_TRASH_MS);
+  actApply(ACT_RINSE_TRASH);
+  progressSleep(CLEAN_WATER_MS);
+  actApply(ACT_DRAIN_TRASH);           // water → air in one frame
+  progressSleep(CLEAN_TRASH_MS);
+  actApply(0);
+}
+
+// Air through the shared path to trash (OUT2 + OUT4) – the drain a full clean owes the line.
+static void drainLineToTrash(uint32_t ms) {
+  Serial.printf("[CLEAN] Trash drain left from the last clean: %u ms\n", (unsigned)ms);
+  actApply(ACT_DRAIN_TRASH);
+  progressSleep(ms);
+  actApply(0);
+}
+
+/* ============================================================================================ */
+/*                                    IDLE CLEANING JOBS                                        */
+/* ============================================================================================ */
+// Sleeps in IDLE_CLEAN_POLL_MS steps; returns the time slept (short when preempted).
+static uint32_t idleJobSleep(uint32_t ms) {
+  uint32_t slept = 0;
+  while (slept < ms && !idleJobStop && isIdle()) {
+    uint32_t step = std::min<uint32_t>(ms - slept, IDLE_CLEAN_POLL_MS);
+    vTaskDelay(pdMS_TO_TICKS(step));
+    slept += step;
+  }
+  return slept;
+}
+
+// Stale-residue rinse (water) and the owed trash drain, routed to trash so a cup
+// on the pad is never touched. Stops at the next poll when a command takes over.
+static void idleCleanJob() {
+  bool rinse = cleanPolicyResidueStale();
+  bool rinsed = false;
+  if (rinse) {
+    Serial.printf("[IDLE-CLEAN] Rinsing stale residue to trash: water %u ms\n", (unsigned)CLEAN_WATER_MS);
+    actApply(ACT_RINSE_TRASH);
+    uint32_t ran = idleJobSleep(CLEAN_WATER_MS);
+    if (ran) idleDrainLeftMs = CLEAN_TRASH_MS; // water is in the line now
+    rinsed = (ran == CLEAN_WATER_MS);
+  }
+  if (idleDrainLeftMs && !idleJobStop && isIdle()) {
+    Serial.printf("[IDLE-CLEAN] Trash drain: %u ms\n", (unsigned)idleDrainLeftMs);
+    actApply(ACT_DRAIN_TRASH);
+    idleDrainLeftMs -= idleJobSleep(idleDrainLeftMs);
+  }
+  actApply(0);
+  if (rinsed && !idleDrainLeftMs) cleanPolicyRecordClean();
+  if (idleDrainLeftMs) {
+    Serial.printf("[IDLE-CLEAN] Preempted; %u ms of drain left for the next pour\n", (unsigned)idleDrainLeftMs);
+  } else {
+    Serial.println("[IDLE-CLEAN] Line clean");
+  }
+}
+
+static void idleCleanTask(void *param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    idleCleanJob();
+    idleJobRunning = false;
+  }
+}
+
+void dcIdleJobsPreempt() {
+  idleJobNotBefore = millis() + IDLE_CLEAN_GAP_MS;
+  if (!idleJobRunning) return;
+  idleJobStop = true;
+  while (idleJobRunning) vTaskDelay(1); // at most one IDLE_CLEAN_POLL_MS step
 }
 
+// STBY clears each channel's fault latch, then everything back to OFF.
+static void ncvClearFaults() {
+  ncvAll(NCV_CMD_STBY);
+  ncvAll(NCV_CMD_OFF);
+  ncvNeedsClear = false;
+}
+
+void dcIdleService() {
+  if (idleJobRunning || !isIdle()) return;
+  if ((idleDrainLeftMs || cleanPolicyResidueStale()) && (long)(millis() - idleJobNotBefore) >= 0) {
+    if (!idleTask) return;
+    idleJobStop    = false;
+    idleJobRunning = true;
+    xTaskNotifyGive(idleTask);
+    return;
+  }
+  if (ncvNeedsClear) {
+    Serial.println("[NCV] Idle: clearing NCV7240 fault latches, all outputs OFF");
+    ncvClearFaults();
+  }
+}
+
+// Always sends (STBY must reach the chips even when the shadow already reads OFF).
 static void ncvAll(uint8_t cmd) {
-  for (uint8_t ch = 1; ch <= 8; ++ch) ncvSetPair(ncvWord[0], ch, cmd);
-  for (uint8_t ch = 1; ch <= 8; ++ch) ncvSetPair(ncvWord[1], ch, cmd);
-  ncvWriteBoth();
+  ncvBegin();
+  for (uint8_t c = 0; c < BOARD_NCV_CHIPS; ++c)
+    for (uint8_t ch = 1; ch <= 8; ++ch) ncvSetPair(ncvWord[c], ch, cmd);
+  ncvDirty = true;
+  ncvCommit();
+}
+
+// Sends the shadow words as one frame (caller holds ncvLock). 16 bits per chip at
+// NCV_SPI_HZ: ~6.4 µs for the standard 2-chip chain; polled, so no interrupt latency.
+// The chain's diagnostics come back in the same frame and are decoded straight away.
+static void ncvWriteChain() {
+  bool driven = false;
+  for (uint8_t i = 0; i < BOARD_NCV_CHIPS; ++i) { // FAR device first, NEAR device last (daisy‑chain)
+    uint16_t w = ncvWord[BOARD_NCV_CHIPS - 1 - i];
+    ncvTx[2 * i]     = (uint8_t)(w >> 8);
+    ncvTx[2 * i + 1] = (uint8_t)(w & 0xFF);
+    driven |= (w != 0xFFFF);
+  }
+  if (driven) ncvNeedsClear = true; // something driven
+  if (!ncvDev) return;
+
+  spi_transaction_t t = {};
+  t.length    = 16 * BOARD_NCV_CHIPS;  // bits
+  t.tx_buffer = ncvTx;
+  t.rx_buffer = ncvRx;
+  if (spi_device_polling_transmit(ncvDev, &t) != ESP_OK) return;
+
+  uint32_t newOpen, newOver;
+  ncvDecodeDiag(newOpen, newOver);
+  if (!(newOpen | newOver)) return;
+  // A channel that trips while ON is switched OFF by the very next frame
+  uint32_t trip = newOver & ncvOnMask();
+  if (trip) {
+    for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+      if (trip & (1ul << (s - 1))) ncvSetPair(ncvWord[BOARD_NCV_LINES[s - 1].chip], BOARD_NCV_LINES[s - 1].ch, NCV_CMD_OFF);
+    }
+    ncvWriteChain();
+  }
+  // Wake the pour task so it fails fast instead of at its next poll
+  if (tlRun.waiter && tlRun.waiter != xTaskGetCurrentTaskHandle()) xTaskNotifyGive(tlRun.waiter);
 }
 
-static void ncvWriteBoth() {
-  // SPI Mode1, MSB first, up to 5 MHz supported by NCV7240 — we use 1 MHz
-  SPISettings settings(1000000, MSBFIRST, SPI_MODE1);
-  uint8_t far_hi = (uint8_t)((ncvWord[1] >> 8) & 0xFF);
-  uint8_t far_lo = (uint8_t)( ncvWord[1]       & 0xFF);
-  uint8_t near_hi= (uint8_t)((ncvWord[0] >> 8) & 0xFF);
-  uint8_t near_lo= (uint8_t)( ncvWord[0]       & 0xFF);
+// Readback follows the send order (FAR word first). Updates the fault masks and
+// counts each new fault once; returns the slots that were not faulted before.
+static void ncvDecodeDiag(uint32_t &newOpen, uint32_t &newOver) {
+  uint32_t open = 0, over = 0;
+  for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+    const NcvLine &l = BOARD_NCV_LINES[s - 1];
+    uint8_t  i = BOARD_NCV_CHIPS - 1 - l.chip;
+    uint16_t w = (uint16_t)(ncvRx[2 * i] << 8) | ncvRx[2 * i + 1];
+    uint8_t  code = (w >> ((l.ch - 1) * 2)) & 0b11;
+    if (code == NCV_DIAG_OPEN_LOAD)     open |= 1ul << (s - 1);
+    else if (code == NCV_DIAG_OVERLOAD) over |= 1ul << (s - 1);
+  }
+  open &= ncvFitted;
+  over &= ncvFitted;
+  newOpen = open & ~ncvOpenMask;
+  newOver = over & ~ncvOverMask;
+  ncvOpenMask = open;
+  ncvOverMask = over;
+  ++ncvFrames;
+  for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+    if (newOpen & (1ul << (s - 1))) ++ncvOpenCount[s - 1];
+    if (newOver & (1ul << (s - 1))) ++ncvOverCount[s - 1];
+  }
+}
 
-  SPI.beginTransaction(settings);
-  digitalWrite(SPI_CS, LOW);
-  // FAR device first, then NEAR device last (daisy‑chain)
-  SPI.transfer(far_hi);  SPI.transfer(far_lo);
-  SPI.transfer(near_hi); SPI.transfer(near_lo);
-  digitalWrite(SPI_CS, HIGH);
-  SPI.endTransaction();
+// Slots faulted in the latest frame's readback (no SPI traffic)
+static uint32_t ncvFaulted() {
+  return ncvOpenMask | ncvOverMask;
+}
+
+// Slots commanded ON in the shadow words
+static uint32_t ncvOnMask() {
+  uint32_t on = 0;
+  for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+    const NcvLine &l = BOARD_NCV_LINES[s - 1];
+    if (((ncvWord[l.chip] >> ((l.ch - 1) * 2)) & 0b11) == NCV_CMD_ON) on |= 1ul << (s - 1);
+  }
+  return on;
+}
+
+void dcValveDiagToJson(JsonObject out) {
+  out["frames"] = ncvFrames;
+  JsonArray ol = out.createNestedArray("open_load");
+  JsonArray ov = out.createNestedArray("overload");
+  JsonArray active = out.createNestedArray("faulted");
+  uint32_t faulted = ncvFaulted();
+  for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+    ol.add(ncvOpenCount[s - 1]);
+    ov.add(ncvOverCount[s - 1]);
+    if (faulted & (1ul << (s - 1))) active.add(s);
+  }
 }
 
 /* ============================================================================================ */
@@ -665,44 +1573,72 @@ void cleanupDrinkController() {
 }
 
 /* ------------------------ Outlet/Top Solenoids (GPIO) ------------------------- */
+// OUT1..OUT4, plus station B's OUT5/OUT6 on dual-station builds
+static constexpr uint8_t OUTLET_PINS[] = { OUT_SOL1_PIN, OUT_SOL2_PIN, OUT_SOL3_PIN, OUT_SOL4_PIN,
+#if POUR_STATIONS > 1
+                                           OUT_SOL5_PIN, OUT_SOL6_PIN,
+#endif
+                                         };
+static constexpr uint8_t OUTLET_COUNT = sizeof(OUTLET_PINS);
+static uint8_t           outletState = 0;   // bit 0 = OUT1, as last written
+
+// All outlets switch with one write to the GPIO set/clear registers (pins 0..31)
+static constexpr bool outletPinsLow(uint8_t i) {
+  return i >= OUTLET_COUNT || (OUTLET_PINS[i] < 32 && outletPinsLow(i + 1));
+}
+static_assert(outletPinsLow(0), "outlet solenoids must be on GPIO 0..31");
+
 static void outletSolenoidsSetup() {
-  pinMode(OUT_SOL1_PIN, OUTPUT);
-  pinMode(OUT_SOL2_PIN, OUTPUT);
-  pinMode(OUT_SOL3_PIN, OUTPUT);
-  pinMode(OUT_SOL4_PIN, OUTPUT);
-  digitalWrite(OUT_SOL1_PIN, LOW);
-  digitalWrite(OUT_SOL2_PIN, LOW);
-  digitalWrite(OUT_SOL3_PIN, LOW);
-  digitalWrite(OUT_SOL4_PIN, LOW);
-}
-
-static void outletSolenoidSet(uint8_t idx, bool on) {
-  uint8_t pin = 0;
-  switch (idx) {
-    case 1: pin = OUT_SOL1_PIN; break;
-    case 2: pin = OUT_SOL2_PIN; break;
-    case 3: pin = OUT_SOL3_PIN; break;
-    case 4: pin = OUT_SOL4_PIN; break;
-    default: return;
-  }
-  digitalWrite(pin, on ? HIGH : LOW);
-  Serial.printf("[OUTLET] OUT%d=%s\n", idx, on ? "ON" : "OFF");
-}
-
-static void outletAllOff() {
-  digitalWrite(OUT_SOL1_PIN, LOW);
-  digitalWrite(OUT_SOL2_PIN, LOW);
-  digitalWrite(OUT_SOL3_PIN, LOW);
-  digitalWrite(OUT_SOL4_PIN, LOW);
-  Serial.println("[OUTLET] All outputs OFF (1..4)");
-}
-
-static void outletSetState(bool s1, bool s2, bool s3, bool s4) {
-  // Set all outputs together for deterministic routing
-  digitalWrite(OUT_SOL1_PIN, s1 ? HIGH : LOW);
-  digitalWrite(OUT_SOL2_PIN, s2 ? HIGH : LOW);
-  digitalWrite(OUT_SOL3_PIN, s3 ? HIGH : LOW);
-  digitalWrite(OUT_SOL4_PIN, s4 ? HIGH : LOW);
-  Serial.printf("[OUTLET] State: OUT1=%s, OUT2=%s, OUT3=%s, OUT4=%s\n",
-                s1?"ON":"OFF", s2?"ON":"OFF", s3?"ON":"OFF", s4?"ON":"OFF");
+  for (uint8_t i = 0; i < OUTLET_COUNT; ++i) {
+    pinMode(OUTLET_PINS[i], OUTPUT);
+    digitalWrite(OUTLET_PINS[i], LOW);
+  }
+  outletState = 0;
+}
+
+// Close before open: the clear register goes first, so two paths never overlap.
+static void outletWrite(uint8_t mask) {
+  uint32_t set = 0, clr = 0;
+  for (uint8_t i = 0; i < OUTLET_COUNT; ++i) {
+    if (mask & (1u << i)) set |= 1ul << OUTLET_PINS[i];
+    else                  clr |= 1ul << OUTLET_PINS[i];
+  }
+  GPIO.out_w1tc = clr;
+  GPIO.out_w1ts = set;
+  outletState = mask;
+}
+
+/* ------------------------------- Actuator mask --------------------------------- */
+// Whole-machine state in one pass: a pump that is stopping stops first, then the
+// outlets (one register write) and the valves (one frame) switch back to back
+// under the SPI lock, then a pump that is starting soft-starts into the open path.
+// A forbidden target is refused and nothing changes.
+static bool actApply(ActuatorMask m, uint8_t pumpPct) {
+  const char *why = actViolation(m);
+  if (why) {
+    Serial.printf("⛔ [ACT] Refused 0x%08lX%08lX: %s\n", (unsigned long)(m >> 32), (unsigned long)m, why);
+    return false;
+  }
+  bool pump = m & ACT_PUMP;
+  if (!pump) pumpOff();
+  ncvBegin();
+  for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) ncvSetSlot(s, m & actSlot(s));
+  outletWrite(actOutletBits(m));
+  ncvCommit();
+  if (pump) pumpOn(pumpPct);
+  return true;
+}
+
+ActuatorMask dcActuators() {
+  return (ActuatorMask)ncvOnMask() | actOutlets(outletState) | (pumpDutyTarget ? ACT_PUMP : 0);
+}
+
+/* ------------------------------ Dual-station pours ----------------------------- */
+static bool pourCupPresent() {
+  return isCupPresentAt(pourStation);
+}
+
+// POUR_RESULT station tag: 1 = A, 2 = B on dual-station builds, untagged otherwise
+static uint8_t pourResultStation() {
+  return POUR_STATIONS > 1 ? pourStation + 1 : 0;
 }
@@ -0,0 +1,194 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: eta_model.cpp
+ *  Description: Online fit of the pour-time model. Updated from the pour task,
+ *               read from the MQTT loop, so every access goes through a
+ *               spinlock; NVS is only touched outside it.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <Preferences.h>
+#include <math.h>
+#include "eta_model.h"
+
+static constexpr uint8_t ETA_NVS_VERSION = 1;
+
+// Stored as one blob in NVS – bump ETA_NVS_VERSION when the layout changes
+struct EtaState {
+    uint8_t  version;
+    float    phaseSec[ETA_PHASE_COUNT];
+    // Forgetting-weighted sums for measured = slope × planned + intercept
+    float    sw, sx, sy, sxx, sxy;
+    // Error statistics (predicted − actual, seconds)
+    uint32_t pours;
+    float    biasSec;     // EMA of signed error
+    float    maeSec;      // EMA of absolute error
+    float    lastPredSec;
+    float    lastActSec;
+};
+
+static EtaState     s_eta;
+static bool         s_loaded = false;
+static portMUX_TYPE s_etaMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void setDefaults(EtaState &st) {
+    memset(&st, 0, sizeof(st));
+    st.version = ETA_NVS_VERSION;
+    st.phaseSec[ETA_PH_PREP]  = 0.05f;
+    st.phaseSec[ETA_PH_START] = 0.05f;  // LED fade runs in the background
+    st.phaseSec[ETA_PH_CLEAN] = (CLEAN_WATER_MS + CLEAN_AIR_TOP_MS) / 1000.0f;
+}
+
+static void ensureLoaded() {
+    if (s_loaded) return;
+    EtaState st;
+    Preferences prefs;
+    bool ok = false;
+    if (prefs.begin("etamodel", true)) {
+        ok = prefs.getBytesLength("state") == sizeof(st) &&
+             prefs.getBytes("state", &st, sizeof(st)) == sizeof(st) &&
+             st.version == ETA_NVS_VERSION;
+        prefs.end();
+    }
+    if (!ok) setDefaults(st);
+    portENTER_CRITICAL(&s_etaMux);
+    if (!s_loaded) { s_eta = st; s_loaded = true; }
+    portEXIT_CRITICAL(&s_etaMux);
+    Serial.printf("[ETA] Model %s (%u pours learned)\n", ok ? "loaded" : "defaults", (unsigned)st.pours);
+}
+
+static void saveState() {
+    EtaState st;
+    portENTER_CRITICAL(&s_etaMux);
+    st = s_eta;
+    portEXIT_CRITICAL(&s_etaMux);
+    Preferences prefs;
+    if (!prefs.begin("etamodel", false)) return;
+    prefs.putBytes("state", &st, sizeof(st));
+    prefs.end();
+}
+
+// Group fit from the weighted sums. Falls back to slope 1 + mean offset until
+// the planned times vary enough to separate slope from intercept.
+static void groupFit(const EtaState &st, float &slope, float &intercept) {
+    slope = 1.0f; intercept = 0.0f;
+    if (st.sw < 1e-3f) return;
+    float mx = st.sx / st.sw, my = st.sy / st.sw;
+    float varX = st.sxx / st.sw - mx * mx;
+    if (st.sw >= 3.0f && varX > 0.25f) {
+        slope = (st.sxy / st.sw - mx * my) / varX;
+        if (slope < 0.5f) slope = 0.5f;
+        if (slope > 2.0f) slope = 2.0f;
+    }
+    intercept = my - slope * mx;
+}
+
+float etaModelPredict(float plannedDispenseSec, uint8_t groups, bool lightClean) {
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    EtaState st = s_eta;
+    portEXIT_CRITICAL(&s_etaMux);
+    float slope, intercept;
+    groupFit(st, slope, intercept);
+    float t = slope * plannedDispenseSec + intercept * groups;
+    t += st.phaseSec[ETA_PH_PREP] + st.phaseSec[ETA_PH_START];
+    t += st.phaseSec[ETA_PH_CLEAN] * (lightClean ? ETA_LIGHT_CLEAN_SHARE : 1.0f);
+    return t > 0.0f ? t : 0.0f;
+}
+
+float etaModelPhaseSec(EtaPhase phase) {
+    if (phase >= ETA_PHASE_COUNT) return 0.0f;
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    float sec = s_eta.phaseSec[phase];
+    portEXIT_CRITICAL(&s_etaMux);
+    return sec;
+}
+
+float etaModelGroupSec(float plannedSec) {
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    EtaState st = s_eta;
+    portEXIT_CRITICAL(&s_etaMux);
+    float slope, intercept;
+    groupFit(st, slope, intercept);
+    float t = slope * plannedSec + intercept;
+    return t > 0.0f ? t : 0.0f;
+}
+
+void etaModelRecordPhase(EtaPhase phase, float sec) {
+    if (phase >= ETA_PHASE_COUNT || sec < 0.0f) return;
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    s_eta.phaseSec[phase] += ETA_PHASE_ALPHA * (sec - s_eta.phaseSec[phase]);
+    portEXIT_CRITICAL(&s_etaMux);
+}
+
+void etaModelRecordGroup(float plannedSec, float measuredSec) {
+    if (plannedSec <= 0.0f || measuredSec <= 0.0f) return;
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    EtaState &st = s_eta;
+    st.sw  = st.sw  * ETA_GROUP_LAMBDA + 1.0f;
+    st.sx  = st.sx  * ETA_GROUP_LAMBDA + plannedSec;
+    st.sy  = st.sy  * ETA_GROUP_LAMBDA + measuredSec;
+    st.sxx = st.sxx * ETA_GROUP_LAMBDA + plannedSec * plannedSec;
+    st.sxy = st.sxy * ETA_GROUP_LAMBDA + plannedSec * measuredSec;
+    portEXIT_CRITICAL(&s_etaMux);
+}
+
+void etaModelRecordPour(float predictedSec, float actualSec) {
+    ensureLoaded();
+    float err = predictedSec - actualSec;
+    portENTER_CRITICAL(&s_etaMux);
+    EtaState &st = s_eta;
+    if (st.pours == 0) {
+        st.biasSec = err;
+        st.maeSec  = fabsf(err);
+    } else {
+        st.biasSec += ETA_ERR_ALPHA * (err - st.biasSec);
+        st.maeSec  += ETA_ERR_ALPHA * (fabsf(err) - st.maeSec);
+    }
+    st.lastPredSec = predictedSec;
+    st.lastActSec  = actualSec;
+    uint32_t pours = ++st.pours;
+    float mae = st.maeSec;
+    portEXIT_CRITICAL(&s_etaMux);
+    Serial.printf("[ETA] Predicted %.2f s, actual %.2f s (error %+.2f s, MAE %.2f s)\n",
+                  predictedSec, actualSec, err, mae);
+    if (pours % ETA_SAVE_EVERY == 0) saveState();
+}
+
+void etaModelToJson(JsonObject out) {
+    ensureLoaded();
+    portENTER_CRITICAL(&s_etaMux);
+    EtaState st = s_eta;
+    portEXIT_CRITICAL(&s_etaMux);
+    float slope, intercept;
+    groupFit(st, slope, intercept);
+    JsonObject ph = out.createNestedObject("phase_s");
+    ph["prep"]  = st.phaseSec[ETA_PH_PREP];
+    ph["start"] = st.phaseSec[ETA_PH_START];
+    ph["clean"] = st.phaseSec[ETA_PH_CLEAN];
+    JsonObject g = out.createNestedObject("group");
+    g["slope"]     = slope;
+    g["intercept"] = intercept;
+    g["weight"]    = st.sw;
+    out["pours"]        = st.pours;
+    out["bias_s"]       = st.biasSec;
+    out["mae_s"]        = st.maeSec;
+    out["last_pred_s"]  = st.lastPredSec;
+    out["last_actual_s"] = st.lastActSec;
+}
+
+void etaModelReset() {
+    EtaState st;
+    setDefaults(st);
+    portENTER_CRITICAL(&s_etaMux);
+    s_eta = st;
+    s_loaded = true;
+    portEXIT_CRITICAL(&s_etaMux);
+    saveState();
+    Serial.println("[ETA] Model reset to defaults");
+}
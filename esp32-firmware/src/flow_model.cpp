@@ -0,0 +1,176 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: flow_model.cpp
+ *  Description: Builds the slot × open-count flow table from NVS calibration.
+ *               All string compares (fit type) and NVS reads happen here, once
+ *               per calibration version, never per scheduler step.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <string.h>
+#include "flow_model.h"
+#include "aws_manager.h"   // flow calibration NVS helpers + version, slot ingredient & volume
+#include "pin_config.h"    // PUMP_SPEED_POUR, POUR_SPLASH_OZS
+
+static constexpr float OZ_PER_L = 33.814f;
+static constexpr float ML_PER_OZ = 29.5735f;
+
+static float    s_totalOzps[FLOW_MAX_OPEN + 1];                   // [n]      pump total
+static float    s_slotOzps[FLOW_MAX_SLOT + 1][FLOW_MAX_OPEN + 1]; // [slot][n] per valve
+static uint8_t  s_pumpPct[FLOW_MAX_OPEN + 1];                     // [n]      regulated pour duty
+static float    s_speedK[FLOW_MAX_OPEN + 1];                      // [n]      flow × vs nominal
+static float    s_gramsPerOz[FLOW_MAX_SLOT + 1];                 // [slot]
+static float    s_fillCurve[FLOW_MAX_SLOT + 1][FILL_CURVE_POINTS]; // [slot][pt]
+static float    s_fillScale[FLOW_MAX_SLOT + 1];                   // [slot] current factor
+static bool     s_built = false;
+static uint32_t s_builtVer = 0;
+
+ViscosityClass viscosityClassForIngredient(uint16_t id) {
+    // ID ranges mirror the `type` blocks of ingredients.json
+    if (id >= 1  && id <= 24) return VISC_ALCOHOL;
+    if (id >= 25 && id <= 35) return VISC_MIXER;
+    if (id >= 36 && id <= 39) return VISC_SOUR;
+    if (id >= 40 && id <= 60) return VISC_SWEET;
+    return VISC_ALCOHOL; // unassigned / unknown: treat as thin
+}
+
+// Legacy total-flow curve from discrete rates or fit (oz/s)
+static float totalFromCalibration(int n, const float *ratesLps, int rateCount,
+                                  const char *fitType, float a, float b, bool loaded) {
+    // Prefer discrete rates and clamp 6+ to the 5th value when present
+    if (loaded && rateCount > 0) {
+        int idx = n;
+        if (idx > 5) idx = 5;
+        if (idx > rateCount) idx = rateCount;
+        float lps = ratesLps[idx - 1];
+        if (lps > 0.0f) return lps * OZ_PER_L;
+    }
+    // If no discrete rates available, try fit (optional)
+    if (loaded) {
+        if (strcmp(fitType, "log") == 0) {
+            float lps = a + b * logf((float)n);
+            if (lps < 0.01f) lps = 0.01f;
+            return lps * OZ_PER_L;
+        } else if (strcmp(fitType, "linear") == 0) {
+            float lps = a + b * n;
+            if (lps < 0.01f) lps = 0.01f;
+            return lps * OZ_PER_L;
+        }
+    }
+    // Fallback to legacy hardcoded oz/s
+    switch (n) {
+        case 1: return 0.38f;
+        case 2: return 0.54f;
+        case 3: return 0.61f;
+        case 4: return 0.65f;
+        default: return 0.68f; // 5+
+    }
+}
+
+void flowModelRefresh() {
+    uint32_t ver = getCalibrationVersion();
+    if (s_built && ver == s_builtVer) return;
+
+    float ratesLps[5] = {0}; int rateCount = 0; char fitType[8] = ""; float a = 0, b = 0;
+    bool loaded = loadFlowCalibrationFromNVS(ratesLps, rateCount, fitType, a, b);
+
+    float slotScale[FLOW_MAX_SLOT]; float viscScale[VISC_CLASS_COUNT];
+    loadFlowScalesFromNVS(slotScale, FLOW_MAX_SLOT, viscScale, VISC_CLASS_COUNT);
+
+    float curves[FLOW_MAX_SLOT * FILL_CURVE_POINTS];
+    loadFillCurvesFromNVS(curves, FLOW_MAX_SLOT, FILL_CURVE_POINTS);
+    for (int slot = 0; slot <= FLOW_MAX_SLOT; ++slot) {
+        for (int p = 0; p < FILL_CURVE_POINTS; ++p) {
+            s_fillCurve[slot][p] = (slot >= 1) ? curves[(slot - 1) * FILL_CURVE_POINTS + p] : 1.0f;
+        }
+        s_fillScale[slot] = 1.0f;
+    }
+
+    s_totalOzps[0] = 0.0f;
+    s_pumpPct[0] = PUMP_SPEED_POUR;
+    s_speedK[0] = 1.0f;
+    for (int n = 1; n <= FLOW_MAX_OPEN; ++n) {
+        s_totalOzps[n] = totalFromCalibration(n, ratesLps, rateCount, fitType, a, b, loaded);
+        // Speed up until the spout sees POUR_SPLASH_OZS, never below nominal
+        float pct = PUMP_SPEED_POUR * POUR_SPLASH_OZS / s_totalOzps[n];
+        if (pct > 100.0f) pct = 100.0f;
+        if (pct < PUMP_SPEED_POUR) pct = PUMP_SPEED_POUR;
+        s_pumpPct[n] = (uint8_t)pct;
+        s_speedK[n]  = (float)s_pumpPct[n] / PUMP_SPEED_POUR;
+    }
+    for (int slot = 0; slot <= FLOW_MAX_SLOT; ++slot) {
+        float k = 0.0f;
+        s_gramsPerOz[slot] = ML_PER_OZ;
+        if (slot >= 1) {
+            k = slotScale[slot - 1];
+            // Only ingredient lines carry a liquid class; the slots after them are water/air
+            if (slot <= BOARD_INGREDIENT_SLOTS) {
+                ViscosityClass vc = viscosityClassForIngredient(getIngredientIdForSlot(slot - 1));
+                k *= viscScale[vc];
+                s_gramsPerOz[slot] = ML_PER_OZ * FLOW_VISC_DENSITY[vc];
+            }
+        }
+        s_slotOzps[slot][0] = 0.0f;
+        for (int n = 1; n <= FLOW_MAX_OPEN; ++n) {
+            s_slotOzps[slot][n] = s_totalOzps[n] / (float)n * k;
+        }
+    }
+    s_builtVer = getCalibrationVersion(); // first-boot defaults bump the version while loading
+    s_built = true;
+    Serial.printf("[FLOW] Model rebuilt for calibration v%u (1 valve %.3f oz/s, 5 valves %.3f oz/s; pour pump %u%%..%u%%)\n",
+                  (unsigned)ver, s_totalOzps[1], s_totalOzps[5], (unsigned)s_pumpPct[FLOW_MAX_OPEN], (unsigned)s_pumpPct[1]);
+}
+
+float flowModelFillFactor(int slot, float litersLeft) {
+    if (slot < 1 || slot > BOARD_INGREDIENT_SLOTS) return 1.0f; // water / air lines have no bottle
+    const float *c = s_fillCurve[slot];
+    if (litersLeft <= FILL_CURVE_L[0]) return c[0];
+    for (int p = 1; p < FILL_CURVE_POINTS; ++p) {
+        if (litersLeft < FILL_CURVE_L[p]) {
+            float t = (litersLeft - FILL_CURVE_L[p - 1]) / (FILL_CURVE_L[p] - FILL_CURVE_L[p - 1]);
+            return c[p - 1] + t * (c[p] - c[p - 1]);
+        }
+    }
+    return c[FILL_CURVE_POINTS - 1];
+}
+
+void flowModelUpdateFill(const IngredientCommand *group, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        int slot = group[i].slot;
+        if (slot < 1 || slot > BOARD_INGREDIENT_SLOTS) continue;
+        float midL = getVolumeLitersForSlot(slot - 1) - 0.5f * group[i].amount / OZ_PER_L;
+        if (midL < 0.0f) midL = 0.0f;
+        s_fillScale[slot] = flowModelFillFactor(slot, midL);
+    }
+}
+
+float flowModelTotalRate(int n) {
+    if (n < 1) n = 1;
+    if (n > FLOW_MAX_OPEN) n = FLOW_MAX_OPEN;
+    return s_totalOzps[n];
+}
+
+float flowModelSlotRate(int slot, int n) {
+    if ((unsigned)slot > FLOW_MAX_SLOT) return 0.0f;
+    if (n > FLOW_MAX_OPEN) n = FLOW_MAX_OPEN;
+    return s_slotOzps[slot][n < 0 ? 0 : n] * s_fillScale[slot];
+}
+
+uint8_t flowModelPumpPct(int n) {
+    if (n < 0) n = 0;
+    if (n > FLOW_MAX_OPEN) n = FLOW_MAX_OPEN;
+    return s_built ? s_pumpPct[n] : PUMP_SPEED_POUR;
+}
+
+float flowModelPourRate(int slot, int n) {
+    if (n < 0) n = 0;
+    if (n > FLOW_MAX_OPEN) n = FLOW_MAX_OPEN;
+    return flowModelSlotRate(slot, n) * s_speedK[n];
+}
+
+float flowModelGramsPerOz(int slot) {
+    if ((unsigned)slot > FLOW_MAX_SLOT) return ML_PER_OZ;
+    return s_gramsPerOz[slot];
+}
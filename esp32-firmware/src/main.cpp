@@ -16,6 +16,8 @@
 #include "led_control.h"
 #include "state_manager.h"
 #include "pressure_pad.h"
+#include "order_queue.h"
+#include "maintenance_controller.h"
 
 /* ---------------- Runtime constants -------------------------------------- */
 static unsigned long lastHeartbeat = 0;
@@ -42,6 +44,7 @@ void setup() {
     }
     
     initDrinkController();
+    initMaintenanceController();
     initLED();
 
     // Start pressure pad sampling ASAP
@@ -96,8 +99,12 @@ void loop() {
         // (Removed periodic pad telemetry log)
     }
 
-    /* 5 · Cup presence LED cue when IDLE only (don’t override pour/clean) */
+    /* 5 · Start the next queued order once idle with a fresh cup (no cloud round trip) */
+    orderQueueService();
+
+    /* 6 · Cup presence LED cue when IDLE only (don’t override pour/clean) */
     if (isIdle()) {
+        dcIdleService();   // deferred cleaning jobs, then pre-clear driver faults
         bool present = isCupPresent();
         if (present != lastCupPresent) {
             lastCupPresent = present;
@@ -0,0 +1,296 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: maint_sequence.cpp
+ *  Description: Step-table executor and the stored cleaning tables. Runs on
+ *               the maintenance worker or the pour task; tables are replaced
+ *               from the MQTT loop, so a run works on its own copy taken
+ *               under a spinlock. NVS is only touched outside it.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "maint_sequence.h"
+#include "drink_controller.h"   // dcApplyActuators()
+#include "pressure_pad.h"
+#include "pin_config.h"         // CLEAN_*_MS, QUICK_CLEAN_MS, PUMP_SPEED_CLEAN
+
+static constexpr uint8_t MSEQ_NVS_VERSION = 2;
+
+struct MaintSeq {
+    uint8_t   count;
+    MaintStep steps[MSEQ_MAX_STEPS];
+};
+
+// Stored as one blob per table – bump MSEQ_NVS_VERSION when the layout changes.
+// Masks are board and station specific (station B's outlets), so a table saved
+// under another profile or station count is ignored.
+struct MaintSeqBlob {
+    uint8_t  version;
+    uint8_t  board;
+    uint8_t  stations;   // POUR_STATIONS
+    MaintSeq seq;
+};
+
+static const char *const SEQ_NAMES[MSEQ_COUNT] = { "QUICK_CLEAN", "FULL_CLEAN", "POUR_CLEAN" };
+
+static const MaintSeq SEQ_DEFAULTS[MSEQ_COUNT] = {
+    { 3, { { ACT_FLUSH_SPOUT, QUICK_CLEAN_MS,   0, 0, MEXIT_NONE },
+           { ACT_PURGE_TOP,   CLEAN_AIR_TOP_MS, 0, 0, MEXIT_NONE },
+           { ACT_DRAIN_TRASH, CLEAN_TRASH_MS,   0, 0, MEXIT_NONE } } },
+    { 3, { { ACT_FLUSH_SPOUT, CLEAN_WATER_MS,   0, 0, MEXIT_NONE },
+           { ACT_PURGE_TOP,   CLEAN_AIR_TOP_MS, 0, 0, MEXIT_NONE },
+           { ACT_DRAIN_TRASH, CLEAN_TRASH_MS,   0, 0, MEXIT_NONE } } },
+    { 2, { { ACT_FLUSH_SPOUT, CLEAN_WATER_MS,   0, 0, MEXIT_NONE },
+           { ACT_PURGE_TOP,   CLEAN_AIR_TOP_MS, 0, 0, MEXIT_NONE } } },
+};
+
+static MaintSeq     s_seq[MSEQ_COUNT];
+static bool         s_custom[MSEQ_COUNT] = {false};
+static bool         s_loaded = false;
+static portMUX_TYPE s_seqMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void ensureLoaded() {
+    if (s_loaded) return;
+    MaintSeq seq[MSEQ_COUNT];
+    bool custom[MSEQ_COUNT] = {false};
+    Preferences prefs;
+    bool open = prefs.begin("maintseq", true);
+    for (uint8_t i = 0; i < MSEQ_COUNT; ++i) {
+        MaintSeqBlob b;
+        custom[i] = open && prefs.getBytesLength(SEQ_NAMES[i]) == sizeof(b) &&
+                    prefs.getBytes(SEQ_NAMES[i], &b, sizeof(b)) == sizeof(b) &&
+                    b.version == MSEQ_NVS_VERSION && b.board == BOARD_PROFILE &&
+                    b.stations == POUR_STATIONS &&
+                    b.seq.count >= 1 && b.seq.count <= MSEQ_MAX_STEPS;
+        seq[i] = custom[i] ? b.seq : SEQ_DEFAULTS[i];
+    }
+    if (open) prefs.end();
+    portENTER_CRITICAL(&s_seqMux);
+    if (!s_loaded) {
+        memcpy(s_seq, seq, sizeof(s_seq));
+        memcpy(s_custom, custom, sizeof(s_custom));
+        s_loaded = true;
+    }
+    portEXIT_CRITICAL(&s_seqMux);
+}
+
+// Returns whether the table is a stored (custom) one, read in the same lock
+static bool copySeq(MaintSeqId id, MaintSeq &out) {
+    ensureLoaded();
+    portENTER_CRITICAL(&s_seqMux);
+    out = s_seq[id];
+    bool custom = s_custom[id];
+    portEXIT_CRITICAL(&s_seqMux);
+    return custom;
+}
+
+static int8_t findSeq(const char *name) {
+    if (!name) return -1;
+    for (uint8_t i = 0; i < MSEQ_COUNT; ++i) {
+        if (!strcmp(name, SEQ_NAMES[i])) return (int8_t)i;
+    }
+    return -1;
+}
+
+const char *mseqName(MaintSeqId id) { return id < MSEQ_COUNT ? SEQ_NAMES[id] : "?"; }
+
+/* --------------------------------- Executor ----------------------------------- */
+static ActuatorMask remapOutlets(ActuatorMask m, const MaintRun &run) {
+    uint8_t outs = actOutletBits(m);
+    if (outs == STATION_A_POUR_OUTS)       outs = run.spoutOuts;
+    else if (outs == STATION_A_PURGE_OUTS) outs = run.purgeOuts;
+    return (m & ~ACT_ALL_OUTLETS) | actOutlets(outs);
+}
+
+static bool exitReached(const MaintStep &st, float g0) {
+    switch (st.exit) {
+        case MEXIT_GRAMS:  return pressurePadWeightReady() && (pressurePadGrams() - g0) >= st.arg;
+        case MEXIT_NO_CUP: return !isCupPresent();
+        default:           return false;
+    }
+}
+
+bool mseqRun(MaintSeqId id, const MaintRun &run) {
+    if (id >= MSEQ_COUNT) return false;
+    MaintSeq seq;
+    copySeq(id, seq);
+    bool ok = true;
+    // Each step ends at an absolute deadline measured from the previous one, so
+    // applying a step (SPI frame, pump ramp start, logging) never adds up.
+    int64_t t = esp_timer_get_time();
+    bool cancelled = false;
+    for (uint8_t i = 0; i < seq.count && ok && !cancelled; ++i) {
+        const MaintStep &st = seq.steps[i];
+        if (st.mask & run.skip) continue;
+        if (run.cancelled && run.cancelled()) { cancelled = true; break; }
+        ActuatorMask m = remapOutlets(st.mask, run);
+        Serial.printf("[SEQ] %s %u/%u: outlets 0x%02X, slots 0x%08lX, pump %s, %lu ms%s\n",
+                      SEQ_NAMES[id], (unsigned)(i + 1), (unsigned)seq.count, (unsigned)actOutletBits(m),
+                      (unsigned long)actSlotBits(m), (m & ACT_PUMP) ? "ON" : "OFF", (unsigned long)st.ms,
+                      st.exit == MEXIT_GRAMS ? " (or weight)" : st.exit == MEXIT_NO_CUP ? " (or cup lifted)" : "");
+        if (!dcApplyActuators(m, st.pumpPct ? st.pumpPct : PUMP_SPEED_CLEAN)) { ok = false; break; }
+        if (run.onStep) run.onStep(st);
+        float g0 = (st.exit == MEXIT_GRAMS && pressurePadWeightReady()) ? pressurePadGrams() : 0.0f;
+        int64_t end = t + (int64_t)st.ms * 1000;
+        bool poll = st.exit != MEXIT_NONE || run.tick || run.cancelled;
+        for (;;) {
+            int64_t now = esp_timer_get_time();
+            if (now >= end) { t = end; break; }
+            if (exitReached(st, g0)) { t = now; break; }
+            if (run.cancelled && run.cancelled()) { cancelled = true; break; }
+            uint32_t leftMs = (uint32_t)((end - now + 999) / 1000);
+            vTaskDelay(pdMS_TO_TICKS(poll && leftMs > MSEQ_POLL_MS ? MSEQ_POLL_MS : leftMs));
+            if (run.tick) run.tick();
+        }
+    }
+    dcApplyActuators(0);
+    if (!ok) Serial.printf("[SEQ] %s stopped – step refused\n", SEQ_NAMES[id]);
+    if (cancelled) Serial.printf("[SEQ] %s cancelled\n", SEQ_NAMES[id]);
+    return ok && !cancelled;
+}
+
+uint32_t mseqDurationMs(MaintSeqId id, ActuatorMask skip) {
+    if (id >= MSEQ_COUNT) return 0;
+    MaintSeq seq;
+    copySeq(id, seq);
+    uint32_t ms = 0;
+    for (uint8_t i = 0; i < seq.count; ++i) {
+        if (!(seq.steps[i].mask & skip)) ms += seq.steps[i].ms;
+    }
+    return ms;
+}
+
+/* ------------------------------- JSON / storage ------------------------------- */
+static const char *stepFromJson(JsonObjectConst js, MaintStep &st) {
+    memset(&st, 0, sizeof(st));
+    const char *route = js["route"] | "none";
+    int outs;
+    if (js["outlets"].is<int>())        outs = js["outlets"].as<int>(); // raw bits, OUT1 = 1
+    else if (!strcmp(route, "spout"))   outs = STATION_A_POUR_OUTS;
+    else if (!strcmp(route, "purge"))   outs = STATION_A_PURGE_OUTS;
+    else if (!strcmp(route, "trash"))   outs = TRASH_OUTS;
+    else if (!strcmp(route, "none"))    outs = 0;
+    else return "bad_route";
+    if (outs < 0 || outs > 0xFF || (actOutlets((uint8_t)outs) & ~ACT_ALL_OUTLETS)) return "bad_outlets";
+    st.mask = actOutlets((uint8_t)outs);
+    if (js["water"] | false) st.mask |= ACT_WATER;
+    if (js["air"] | false)   st.mask |= ACT_AIR;
+    for (JsonVariantConst v : js["slots"].as<JsonArrayConst>()) {
+        int s = v | 0;
+        if (s < 1 || s > BOARD_SPI_SLOTS) return "bad_slot";
+        st.mask |= actSlot((uint8_t)s);
+    }
+    JsonVariantConst pump = js["pump"];
+    if (pump.is<bool>()) {
+        if (pump.as<bool>()) st.mask |= ACT_PUMP;
+    } else if (pump.is<int>()) {
+        int pct = pump.as<int>();
+        if (pct < 0 || pct > 100) return "bad_pump";
+        if (pct) { st.mask |= ACT_PUMP; st.pumpPct = (uint8_t)pct; }
+    }
+    uint32_t ms = js["ms"] | 0u;
+    if (!ms || ms > MSEQ_MAX_STEP_MS) return "bad_ms";
+    st.ms = ms;
+    const char *until = js["until"] | "";
+    if (!strcmp(until, "grams")) {
+        int g = js["g"] | 0;
+        if (g <= 0 || g > 1000) return "bad_grams";
+        st.exit = MEXIT_GRAMS;
+        st.arg  = (uint16_t)g;
+    } else if (!strcmp(until, "no_cup")) {
+        st.exit = MEXIT_NO_CUP;
+    } else if (*until) {
+        return "bad_until";
+    }
+    return actViolation(st.mask); // interlocks hold for stored tables too
+}
+
+static void stepToJson(const MaintStep &st, JsonObject js) {
+    uint8_t outs = actOutletBits(st.mask);
+    if (outs == STATION_A_POUR_OUTS)       js["route"] = "spout";
+    else if (outs == STATION_A_PURGE_OUTS) js["route"] = "purge";
+    else if (outs == TRASH_OUTS)           js["route"] = "trash";
+    else if (!outs)                        js["route"] = "none";
+    else                                   js["outlets"] = outs;
+    if (st.mask & ACT_WATER) js["water"] = true;
+    if (st.mask & ACT_AIR)   js["air"] = true;
+    uint32_t lines = actSlotBits(st.mask & ~(ACT_WATER | ACT_AIR));
+    if (lines) {
+        JsonArray arr = js.createNestedArray("slots");
+        for (uint8_t s = 1; s <= BOARD_SPI_SLOTS; ++s) {
+            if (lines & (1ul << (s - 1))) arr.add(s);
+        }
+    }
+    if (!(st.mask & ACT_PUMP)) js["pump"] = false;
+    else if (st.pumpPct)       js["pump"] = st.pumpPct;
+    else                       js["pump"] = true;
+    js["ms"] = st.ms;
+    if (st.exit == MEXIT_GRAMS) { js["until"] = "grams"; js["g"] = st.arg; }
+    else if (st.exit == MEXIT_NO_CUP) js["until"] = "no_cup";
+}
+
+const char *mseqSetFromJson(JsonObjectConst cmd) {
+    int8_t id = findSeq(cmd["name"] | "");
+    if (id < 0) return "bad_name";
+    JsonArrayConst steps = cmd["steps"].as<JsonArrayConst>();
+    if (steps.isNull() || steps.size() < 1 || steps.size() > MSEQ_MAX_STEPS) return "bad_steps";
+    MaintSeqBlob b;
+    memset(&b, 0, sizeof(b));
+    b.version  = MSEQ_NVS_VERSION;
+    b.board    = BOARD_PROFILE;
+    b.stations = POUR_STATIONS;
+    for (JsonObjectConst js : steps) {
+        const char *err = stepFromJson(js, b.seq.steps[b.seq.count]);
+        if (err) return err;
+        ++b.seq.count;
+    }
+    ensureLoaded();
+    Preferences prefs;
+    if (!prefs.begin("maintseq", false)) return "nvs";
+    bool saved = prefs.putBytes(SEQ_NAMES[id], &b, sizeof(b)) == sizeof(b);
+    prefs.end();
+    if (!saved) return "nvs";
+    portENTER_CRITICAL(&s_seqMux);
+    s_seq[id] = b.seq;
+    s_custom[id] = true;
+    portEXIT_CRITICAL(&s_seqMux);
+    Serial.printf("[SEQ] %s replaced: %u steps, %lu ms\n", SEQ_NAMES[id], (unsigned)b.seq.count,
+                  (unsigned long)mseqDurationMs((MaintSeqId)id));
+    return nullptr;
+}
+
+bool mseqReset(const char *name) {
+    int8_t id = findSeq(name);
+    if (id < 0) return false;
+    ensureLoaded();
+    Preferences prefs;
+    if (prefs.begin("maintseq", false)) {
+        prefs.remove(SEQ_NAMES[id]);
+        prefs.end();
+    }
+    portENTER_CRITICAL(&s_seqMux);
+    s_seq[id] = SEQ_DEFAULTS[id];
+    s_custom[id] = false;
+    portEXIT_CRITICAL(&s_seqMux);
+    Serial.printf("[SEQ] %s reset to the built-in table\n", SEQ_NAMES[id]);
+    return true;
+}
+
+void mseqToJson(JsonObject out) {
+    JsonObject all = out.createNestedObject("sequences");
+    for (uint8_t i = 0; i < MSEQ_COUNT; ++i) {
+        MaintSeq seq;
+        bool custom = copySeq((MaintSeqId)i, seq);
+        uint32_t ms = 0;   // from the same copy as the steps
+        for (uint8_t k = 0; k < seq.count; ++k) ms += seq.steps[k].ms;
+        JsonObject o = all.createNestedObject(SEQ_NAMES[i]);
+        o["custom"] = custom;
+        o["ms"]     = ms;
+        JsonArray arr = o.createNestedArray("steps");
+        for (uint8_t k = 0; k < seq.count; ++k) stepToJson(seq.steps[k], arr.add<JsonObject>());
+    }
+}
@@ -7,12 +7,37 @@
 
 #include <Arduino.h>
 #include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
 #include "maintenance_controller.h"
 #include "state_manager.h"
 #include "aws_manager.h"
 #include "led_control.h"
 #include "pin_config.h"
+#include "board_profile.h"   // BOARD_SLOT_WATER / AIR, slot counts
 #include "drink_controller.h"
+#include "pressure_pad.h"
+#include "flow_model.h"
+#include "clean_policy.h"
+#include "maint_sequence.h"
+#include "prime_model.h"
+#include <ArduinoJson.h>
+
+// Fitted ingredient lines 1..N as an actuator mask
+static ActuatorMask fittedIngredients() {
+    return (ActuatorMask)((1ul << dcGetIngredientCount()) - 1);
+}
+
+// Starting an open-ended mode: a target the interlocks refuse changes nothing, and
+// cleanupDrinkController() has left everything off, so the mode just does not start
+static bool applyOrIdle(ActuatorMask m, const char *failMsg, uint8_t pumpPct = PUMP_SPEED_CLEAN) {
+    if (dcApplyActuators(m, pumpPct)) return true;
+    setState(State::IDLE);
+    ledIdle();
+    if (failMsg) sendData(MAINTENANCE_TOPIC, failMsg);
+    return false;
+}
 
 // --- Single-ingredient emptying state ---
 static std::atomic<bool> emptyingSingleIngredient{false};
@@ -21,15 +46,18 @@ static uint8_t currentEmptySlot = 0;
 // --- Calibration state ---
 static std::atomic<bool> calibrationActive{false};
 static uint8_t calibrationSolenoids = 0;
+static std::atomic<bool> autoCalibAbort{false};
+static std::atomic<bool> autoCalibRunning{false};
+static uint32_t autoCalibWindowMs = AUTO_CALIB_WINDOW_MS;
 
-// Start emptying a single ingredient (slot 1-12)
+// Start emptying a single ingredient (slot 1..BOARD_INGREDIENT_SLOTS)
 void startEmptyIngredientTask(uint8_t ingredientSlot) {
     if (getCurrentState() != State::IDLE) {
         Serial.println("✖ Cannot start EMPTY_INGREDIENT: System not IDLE");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"busy\"}");
         return;
     }
-    if (ingredientSlot < 1 || ingredientSlot > 12) {
+    if (ingredientSlot < 1 || ingredientSlot > BOARD_INGREDIENT_SLOTS) {
         Serial.println("✖ Invalid ingredient slot for EMPTY_INGREDIENT");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"bad_slot\"}");
         return;
@@ -39,19 +67,10 @@ void startEmptyIngredientTask(uint8_t ingredientSlot) {
     Serial.printf("→ State set to MAINTENANCE (EMPTY_INGREDIENT %u)\n", (unsigned)ingredientSlot);
     cleanupDrinkController();
 
-    // Output path: OUT1=ON, OUT2=OFF, OUT3=ON, OUT4=OFF
-    dcOutletSetState(true, false, true, false);
-    // Ensure WATER and TRASH/AIR are OFF
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-
-    // Open only the selected ingredient slot
-    for (uint8_t slot = 1; slot <= 12; ++slot) {
-        dcSetSpiSlot(slot, slot == ingredientSlot);
-    }
-
-    // Start pump (MOSFET)
-    dcPumpOn();
+    // Spout path (OUT1 + OUT3), only the selected ingredient open, water and
+    // trash/air closed, pump on – one step
+    if (!applyOrIdle(ACT_ROUTE_SPOUT | actSlot(ingredientSlot) | ACT_PUMP,
+                     "{\"status\":\"fail\",\"error\":\"interlock\"}")) return;
 
     emptyingSingleIngredient = true;
     currentEmptySlot = ingredientSlot;
@@ -62,15 +81,11 @@ void startEmptyIngredientTask(uint8_t ingredientSlot) {
 void stopEmptyIngredientTask() {
     // Always perform the stop sequence, regardless of state
     Serial.println("[FORCE STOP] Stopping EMPTY_INGREDIENT sequence (if running)");
-    // Close all ingredient slots
-    for (uint8_t slot = 1; slot <= 14; ++slot) {
-        dcSetSpiSlot(slot, false);
-    }
-    // Stop pump and close outlets
-    dcPumpOff();
-    dcOutletAllOff();
+    // Close all slots, stop pump and close outlets
+    dcApplyActuators(0);
     setState(State::IDLE);
     ledIdle();
+    if (currentEmptySlot) cleanPolicyMarkResidue(1u << (currentEmptySlot - 1)); // ran through the spout path
     emptyingSingleIngredient = false;
     currentEmptySlot = 0;
     sendData(MAINTENANCE_TOPIC, "{\"status\":\"ok\",\"action\":\"EMPTY_INGREDIENT_STOP\"}");
@@ -79,50 +94,136 @@ void stopEmptyIngredientTask() {
 
 // Durations are defined in pin_config.h and used by drink_controller. Avoid duplicating here.
 
-// --- FreeRTOS task forward declarations ---
+// --- Maintenance worker -------------------------------------------------------
+// One long-lived task (static stack) runs every blocking sequence below, so a
+// command costs one queue send and two sequences can never drive the hardware
+// at the same time. maintBusy is claimed by the submitter and released by the
+// worker when the job returns.
+struct MaintJob { TaskFunction_t fn; const char *name; bool preemptible; };
+static constexpr uint32_t MAINT_TASK_STACK = 4096;
+static StaticTask_t       maintTaskTcb;
+static StackType_t        maintTaskStack[MAINT_TASK_STACK];
+static StaticQueue_t      maintQueueBuf;
+static uint8_t            maintQueueStore[sizeof(MaintJob)];
+static QueueHandle_t      maintQueue = nullptr;
+static std::atomic<bool>  maintBusy{false};
+
+// Cancel token of the queued/running job: reset when a job is submitted, set by
+// maintCancel() (operator) or maintPreemptForOrder() (drink order, preemptible
+// jobs only). Jobs poll it at every step boundary and every MAINT_CANCEL_POLL_MS.
+enum MaintCancelBy : uint8_t { MCANCEL_NONE = 0, MCANCEL_OPERATOR, MCANCEL_ORDER };
+static std::atomic<uint8_t> maintCancelBy{MCANCEL_NONE};
+static std::atomic<bool>    maintPreemptOk{false};
+static const char          *maintJobName = nullptr;   // for the cancel report
+
+static bool maintCancelled() { return maintCancelBy.load() != MCANCEL_NONE; }
+
+// vTaskDelay in MAINT_CANCEL_POLL_MS slices. False = cancelled.
+static bool maintWait(uint32_t ms) {
+    while (ms > 0) {
+        if (maintCancelled()) return false;
+        uint32_t step = ms > MAINT_CANCEL_POLL_MS ? MAINT_CANCEL_POLL_MS : ms;
+        vTaskDelay(pdMS_TO_TICKS(step));
+        ms -= step;
+    }
+    return !maintCancelled();
+}
+
+// Step tables run by the jobs stop on the same token
+static MaintRun cancellableRun() {
+    MaintRun run;
+    run.cancelled = maintCancelled;
+    return run;
+}
+
+// A job that saw the token: hardware is already off; report and hand the device back
+static void maintFinishCancelled(const char *action) {
+    const bool byOrder = maintCancelBy.load() == MCANCEL_ORDER;
+    setState(State::IDLE);
+    ledIdle();
+    char buf[112];
+    snprintf(buf, sizeof(buf), "{\"status\":\"cancelled\",\"action\":\"%s\",\"reason\":\"%s\"}",
+             action, byOrder ? "order" : "operator");
+    sendData(MAINTENANCE_TOPIC, String(buf));
+    Serial.printf("→ %s cancelled (%s) – all actuators off, state IDLE\n", action, byOrder ? "drink order" : "operator");
+}
+
+static void maintWorkerTask(void *param) {
+    MaintJob job;
+    for (;;) {
+        if (xQueueReceive(maintQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+        Serial.printf("[MAINT] Running %s%s\n", job.name, job.preemptible ? " (preemptible)" : "");
+        maintJobName = job.name;
+        maintPreemptOk = job.preemptible;
+        job.fn(nullptr);
+        maintPreemptOk = false;
+        maintJobName = nullptr;
+        maintBusy = false;
+    }
+}
+
+// Hand a sequence to the worker. False if one is already queued or running.
+// preemptible: a drink order arriving meanwhile cancels it (maintPreemptForOrder).
+static bool maintSubmit(TaskFunction_t fn, const char *name, bool preemptible = false) {
+    bool expected = false;
+    if (!maintQueue || !maintBusy.compare_exchange_strong(expected, true)) {
+        Serial.printf("✖ %s rejected: another maintenance sequence is running\n", name);
+        return false;
+    }
+    maintCancelBy = MCANCEL_NONE;
+    MaintJob job = { fn, name, preemptible };
+    if (xQueueSend(maintQueue, &job, 0) != pdTRUE) { maintBusy = false; return false; }
+    return true;
+}
+
+void initMaintenanceController() {
+    maintQueue = xQueueCreateStatic(1, sizeof(MaintJob), maintQueueStore, &maintQueueBuf);
+    xTaskCreateStaticPinnedToCore(maintWorkerTask, "MaintTask", MAINT_TASK_STACK, nullptr, 1,
+                                  maintTaskStack, &maintTaskTcb, 1);
+}
+
+// --- Job forward declarations (run on the maintenance worker) ---
 static void readySystemTask(void *param);
 static void emptySystemTask(void *param);
 static void quickCleanTask(void *param);
 // New: run blocking sequences asynchronously
 static void customCleanStopTask(void *param);
 static void deepCleanFinalFlushTask(void *param);
+static void autoCalibrationTask(void *param);
 
 // Example: Ready system (prime tubes)
-void startReadySystemTask() {
+void startReadySystemTask(bool preemptible) {
     if (getCurrentState() != State::IDLE) {
         Serial.println("✖ Cannot start READY_SYSTEM: System not IDLE");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"busy\"}");
         return;
     }
-    // Start FreeRTOS task for non-blocking maintenance
-    if (xTaskCreate(readySystemTask, "readySystemTask", 4096, nullptr, 1, nullptr) != pdPASS) {
-        Serial.println("❌ Failed to create READY_SYSTEM task");
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"task_fail\"}");
+    // Hand off to the maintenance worker (non-blocking)
+    if (!maintSubmit(readySystemTask, "READY_SYSTEM", preemptible)) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"busy\"}");
     }
 }
 
-void startEmptySystemTask() {
+void startEmptySystemTask(bool preemptible) {
     if (getCurrentState() != State::IDLE) {
         Serial.println("✖ Cannot start EMPTY_SYSTEM: System not IDLE");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"busy\"}");
         return;
     }
-    if (xTaskCreate(emptySystemTask, "emptySystemTask", 4096, nullptr, 1, nullptr) != pdPASS) {
-        Serial.println("❌ Failed to create EMPTY_SYSTEM task");
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"task_fail\"}");
+    if (!maintSubmit(emptySystemTask, "EMPTY_SYSTEM", preemptible)) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"error\":\"busy\"}");
     }
 }
 
 // QUICK_CLEAN – short automatic rinse
-void startQuickCleanTask() {
+void startQuickCleanTask(bool preemptible) {
     if (getCurrentState() != State::IDLE) {
         Serial.println("✖ Cannot start QUICK_CLEAN: System not IDLE");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"QUICK_CLEAN\",\"error\":\"busy\"}");
         return;
     }
-    if (xTaskCreate(quickCleanTask, "quickCleanTask", 4096, nullptr, 1, nullptr) != pdPASS) {
-        Serial.println("❌ Failed to create QUICK_CLEAN task");
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"QUICK_CLEAN\",\"error\":\"task_fail\"}");
+    if (!maintSubmit(quickCleanTask, "QUICK_CLEAN", preemptible)) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"QUICK_CLEAN\",\"error\":\"busy\"}");
     }
 }
 
@@ -137,7 +238,7 @@ void customCleanStart(uint8_t ingredientSlot, uint8_t phase) {
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"busy\"}");
         return;
     }
-    if (ingredientSlot < 1 || ingredientSlot > 12) {
+    if (ingredientSlot < 1 || ingredientSlot > BOARD_INGREDIENT_SLOTS) {
         Serial.println("✖ CUSTOM_CLEAN bad slot");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"bad_slot\"}");
         return;
@@ -146,15 +247,9 @@ void customCleanStart(uint8_t ingredientSlot, uint8_t phase) {
     fadeToRed();
     cleanupDrinkController();
 
-    // Route fluid to spout: OUT1=ON, OUT3=ON
-    dcOutletSetState(true, false, true, false);
-    // Specials closed; open only selected ingredient slot
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-    for (uint8_t s = 1; s <= 12; ++s) dcSetSpiSlot(s, s == ingredientSlot);
-
-        // Start pump (MOSFET)
-        dcPumpOn();
+    // Route fluid to spout (OUT1 + OUT3), open only the selected ingredient, pump on
+    if (!applyOrIdle(ACT_ROUTE_SPOUT | actSlot(ingredientSlot) | ACT_PUMP,
+                     "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"interlock\"}")) return;
 
     customActive = true;
     customSlot = ingredientSlot;
@@ -168,10 +263,9 @@ void customCleanStart(uint8_t ingredientSlot, uint8_t phase) {
 }
 
 void customCleanStop() {
-    // Offload the multi-step sequence to its own task to avoid blocking loop()
-    if (xTaskCreate(customCleanStopTask, "customCleanStopTask", 4096, nullptr, 1, nullptr) != pdPASS) {
-        Serial.println("❌ Failed to create CUSTOM_CLEAN_STOP task");
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"task_fail\"}");
+    // Offload the multi-step sequence to the worker to avoid blocking loop()
+    if (!maintSubmit(customCleanStopTask, "CUSTOM_CLEAN_STOP")) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"busy\"}");
     }
 }
 
@@ -181,8 +275,10 @@ void customCleanResume(uint8_t ingredientSlot, uint8_t phase) {
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"busy\"}");
         return;
     }
-        // Start pump (MOSFET)
-        dcPumpOn();
+    // Start pump on the path left set up (refused if no outlet is open)
+    if (!dcApplyActuators(dcActuators() | ACT_PUMP)) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"CUSTOM_CLEAN\",\"error\":\"interlock\"}");
+    }
 }
 
 // Deep clean per-line control
@@ -195,26 +291,21 @@ void deepCleanStartLine(uint8_t ingredientSlot) {
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN\",\"error\":\"busy\"}");
         return;
     }
-    if (ingredientSlot < 1 || ingredientSlot > 12) {
+    if (ingredientSlot < 1 || ingredientSlot > BOARD_INGREDIENT_SLOTS) {
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN\",\"error\":\"bad_slot\"}");
         return;
     }
     setState(State::MAINTENANCE);
     fadeToRed();
     cleanupDrinkController();
-    // Route to spout (Outputs: 1=ON,2=OFF,3=ON,4=OFF)
-    dcOutletSetState(true, false, true, false);
-    // Open chosen slot only, specials closed (13=water OFF, 14=trash/air OFF)
-    for (uint8_t s = 1; s <= 14; ++s) dcSetSpiSlot(s, false);
-    dcSetSpiSlot(ingredientSlot, true);
-
-        // Start pump (MOSFET)
-        dcPumpOn();
+    // Route to spout (Outputs: 1=ON,2=OFF,3=ON,4=OFF), chosen slot only, specials closed, pump on
+    if (!applyOrIdle(ACT_ROUTE_SPOUT | actSlot(ingredientSlot) | ACT_PUMP,
+                     "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN\",\"error\":\"interlock\"}")) return;
 
     // Verbose logging for parity with CUSTOM_CLEAN
     Serial.println("[DEEP_CLEAN][START] Per-line deep clean");
     Serial.printf("  - Outputs: [1=ON,2=OFF,3=ON,4=OFF]\n");
-    Serial.printf("  - SPI: [slot %u=ON, 13=OFF (water), 14=OFF (trash/air)]\n", (unsigned)ingredientSlot);
+    Serial.printf("  - SPI: [slot %u=ON, water=OFF, trash/air=OFF]\n", (unsigned)ingredientSlot);
     Serial.println("  - Pump ON");
     deepLineActive = true;
     deepLineSlot = ingredientSlot;
@@ -225,11 +316,8 @@ void deepCleanStartLine(uint8_t ingredientSlot) {
 
 void deepCleanStopLine() {
     Serial.println("[DEEP_CLEAN][STOP] Stopping per-line deep clean");
-    // Close all SPI solenoids (includes the selected ingredient and specials)
-    for (uint8_t s = 1; s <= 14; ++s) dcSetSpiSlot(s, false);
-    // Stop pump and close outlets
-        dcPumpOff();
-    dcOutletAllOff();
+    // Close all SPI solenoids (includes the selected ingredient and specials), stop pump, close outlets
+    dcApplyActuators(0);
     setState(State::IDLE);
     ledIdle();
     deepLineActive = false;
@@ -241,15 +329,55 @@ void deepCleanStopLine() {
 
 void deepCleanFinalFlush() {
     // Keep the public API but run the sequence asynchronously
-    if (xTaskCreate(deepCleanFinalFlushTask, "deepCleanFinalFlushTask", 4096, nullptr, 1, nullptr) != pdPASS) {
-        Serial.println("❌ Failed to create DEEP_CLEAN_FINAL task");
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN_FINAL\",\"error\":\"task_fail\"}");
+    if (!maintSubmit(deepCleanFinalFlushTask, "DEEP_CLEAN_FINAL")) {
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN_FINAL\",\"error\":\"busy\"}");
     }
 }
 
-// --- FreeRTOS task implementations ---
+// --- Cancellation ---
+bool maintCancel() {
+    if (maintBusy) {
+        // The job stops itself at its next check; AUTO_CALIBRATE has its own abort flag
+        uint8_t none = MCANCEL_NONE;
+        maintCancelBy.compare_exchange_strong(none, MCANCEL_OPERATOR);
+        if (autoCalibRunning) autoCalibAbort = true;
+        Serial.printf("[MAINT] Cancel requested for %s\n", maintJobName ? maintJobName : "queued job");
+        return true;
+    }
+    // Open-ended modes hold the hardware without a job: switch off right here
+    const char *action = customActive             ? "CUSTOM_CLEAN"
+                       : deepLineActive           ? "DEEP_CLEAN"
+                       : emptyingSingleIngredient ? "EMPTY_INGREDIENT"
+                       : calibrationActive        ? "CALIBRATION"
+                                                  : nullptr;
+    if (!action) return false;
+    dcApplyActuators(0);
+    customActive = false;
+    deepLineActive = false;
+    emptyingSingleIngredient = false;
+    if (currentEmptySlot) cleanPolicyMarkResidue(1u << (currentEmptySlot - 1)); // as in stopEmptyIngredientTask
+    currentEmptySlot = 0;
+    calibrationActive = false;
+    calibrationSolenoids = 0;
+    maintCancelBy = MCANCEL_OPERATOR;   // report reason; reset by the next maintSubmit()
+    maintFinishCancelled(action);
+    return true;
+}
+
+bool maintPreemptible() { return maintBusy && maintPreemptOk; }
+
+bool maintPreemptForOrder() {
+    if (!maintPreemptible()) return false;
+    uint8_t none = MCANCEL_NONE;
+    if (maintCancelBy.compare_exchange_strong(none, MCANCEL_ORDER)) {
+        Serial.printf("[MAINT] %s preempted by a drink order\n", maintJobName ? maintJobName : "Job");
+    }
+    return true;
+}
+
+// --- Job implementations (maintenance worker) ---
 static void readySystemTask(void *param) {
-        // "Load Ingredients" / prime each ingredient line (1..N) individually
+        // "Load Ingredients" / prime every ingredient line (1..N), several at once
         setState(State::MAINTENANCE);
         fadeToRed();
         Serial.println("→ State set to MAINTENANCE (LOAD_INGREDIENTS)");
@@ -257,63 +385,116 @@ static void readySystemTask(void *param) {
         // Safety baseline: close all SPI slots, stop pump, close all outlets
         cleanupDrinkController();
 
-        // Output path for priming: OUT1=ON, OUT3=ON, OUT2=OFF, OUT4=OFF
-        dcOutletSetState(true, false, true, false);
-        // Ensure SPI specials are CLOSED (13=water, 14=trash/air)
-        dcSetSpiSlot(13, false);
-        dcSetSpiSlot(14, false);
-
-        // Per-slot prime durations (ms). Adjustable to account for tube length.
-        // Defaults chosen conservatively; tailor to your machine.
-        const uint8_t maxIngr = dcGetIngredientCount(); // 0..12 based on device ID
-        const uint32_t defaultMs = 1200; // 1.2s baseline
-        uint32_t primeMs[12] = {
-            1200, // 1
-            1200, // 2
-            1200, // 3
-            1200, // 4
-            1400, // 5 (example: longer run)
-            1400, // 6
-            1000, // 7 (example: shorter)
-            1000, // 8
-            1300, // 9
-            1300, // 10
-            1500, // 11
-            1500  // 12
+        // Lines 1..N, longest first, up to `open` at a time: as one line closes
+        // the next opens in the same actuator step, so the pump never stops.
+        // Output path for priming: OUT1=ON, OUT3=ON; specials (water, trash/air) closed.
+        const uint8_t maxIngr = dcGetIngredientCount(); // 0..BOARD_INGREDIENT_SLOTS based on device ID
+        uint8_t order[BOARD_INGREDIENT_SLOTS];
+        uint32_t planMs = 0;
+        const uint8_t open = primeModelPlan(maxIngr, order, planMs);
+
+        // With a container on the weighing pad, a line closes once its liquid is
+        // seen at the spout: mass beyond what the lines already flowing should
+        // have delivered means the next line (earliest expected) has arrived.
+        const bool weigh = pressurePadWeightReady() && isCupPresent();
+        if (weigh) pressurePadTare();
+        const float speedK = (float)PUMP_SPEED_CLEAN / PUMP_SPEED_POUR;  // flow ∝ duty
+        Serial.printf("[LOAD] Priming %u lines, %u at a time (~%u ms)%s\n", (unsigned)maxIngr,
+                      (unsigned)open, (unsigned)planMs, weigh ? ", watching the pad" : "");
+
+        // arrivedAt 0 = not yet; openSum = ∫ lines open dt (ms) while this one was open
+        struct PrimeLine { uint8_t slot; uint32_t openAt, expectMs, arrivedAt; float openSum; };
+        PrimeLine lines[PRIME_MAX_OPEN];
+        uint8_t nOpen = 0, next = 0, learned = 0;
+        uint32_t tAccrued = 0;
+        // Lines open together change as others close: learn against the mean count
+        auto accrue = [&](uint32_t t) {
+                for (uint8_t i = 0; i < nOpen; ++i) lines[i].openSum += (float)nOpen * (t - tAccrued);
+                tAccrued = t;
         };
-
-        // Start pump to draw liquids
-        dcPumpOn();
-
-        // Loop ingredients 1..maxIngr, one-at-a-time, quick succession
-        for (uint8_t slot = 1; slot <= maxIngr; ++slot) {
-                // Open only this slot; others remain closed
-                Serial.printf("[LOAD] Priming slot %u for %u ms\n", (unsigned)slot,
-                                            (unsigned)primeMs[slot-1]);
-                // Make sure specials closed every iteration
-                dcSetSpiSlot(13, false);
-                dcSetSpiSlot(14, false);
-                // Open this ingredient
-                dcSetSpiSlot(slot, true);
-                vTaskDelay(pdMS_TO_TICKS(primeMs[slot-1]));
-                dcSetSpiSlot(slot, false);
-                // tiny inter-slot gap to avoid water-hammer
-                vTaskDelay(pdMS_TO_TICKS(60));
+        auto meanOpen = [](const PrimeLine &ln, uint32_t t) {
+                return t > ln.openAt ? ln.openSum / (t - ln.openAt) : 1.0f;
+        };
+        ActuatorMask applied = 0;
+        float expectG = 0.0f;
+        const uint32_t t0 = millis();
+        uint32_t lastMs = 0;
+        ActuatorMask reached = 0;   // lines that were open at some point
+        bool refused = false;
+        while ((next < maxIngr || nOpen) && !maintCancelled()) {
+                uint32_t now = millis() - t0 + 1;   // +1: 0 is "not arrived"
+                accrue(now);
+                for (uint8_t i = 0; i < nOpen; ) {
+                        PrimeLine &ln = lines[i];
+                        bool done = ln.arrivedAt ? now >= ln.arrivedAt + PRIME_TAIL_MS
+                                  : weigh        ? now >= ln.openAt + ln.expectMs * PRIME_TIMEOUT_PCT / 100
+                                                 : now >= ln.openAt + ln.expectMs + PRIME_TAIL_MS;
+                        if (!done) { ++i; continue; }
+                        if (weigh && !ln.arrivedAt) {
+                                // Not seen in time: the timeout is only a lower bound, so
+                                // a longer tube catches up over a few runs
+                                Serial.printf("[LOAD] Slot %u not seen at the spout\n", (unsigned)ln.slot);
+                                primeModelRecordAtLeast(ln.slot, meanOpen(ln, now), now - ln.openAt);
+                        }
+                        lines[i] = lines[--nOpen];
+                }
+                while (nOpen < open && next < maxIngr) {
+                        uint8_t slot = order[next++];
+                        lines[nOpen++] = { slot, now, primeModelMs(slot, open), 0, 0.0f };
+                        Serial.printf("[LOAD] Priming slot %u (~%u ms)\n", (unsigned)slot, (unsigned)lines[nOpen - 1].expectMs);
+                }
+                if (!nOpen) break;
+                ActuatorMask m = 0;
+                for (uint8_t i = 0; i < nOpen; ++i) m |= actSlot(lines[i].slot);
+                if (m != applied) {
+                        if (!dcApplyActuators(ACT_ROUTE_SPOUT | m | ACT_PUMP)) { refused = true; break; }
+                        applied = m;
+                        reached |= m;
+                }
+
+                vTaskDelay(pdMS_TO_TICKS(PRIME_POLL_MS));
+                if (!weigh) continue;
+                uint32_t tMs = millis() - t0 + 1;
+                accrue(tMs);
+                float dt = (tMs - lastMs) / 1000.0f;
+                lastMs = tMs;
+                int8_t first = -1;
+                for (uint8_t i = 0; i < nOpen; ++i) {
+                        const PrimeLine &ln = lines[i];
+                        if (ln.arrivedAt) {
+                                expectG += dt * speedK * flowModelSlotRate(ln.slot, nOpen) * flowModelGramsPerOz(ln.slot);
+                        } else if (first < 0 || ln.openAt + ln.expectMs < lines[first].openAt + lines[first].expectMs) {
+                                first = (int8_t)i;
+                        }
+                }
+                float excess = pressurePadGrams() - expectG;
+                if (first < 0 || excess < PRIME_ARRIVE_G) continue;
+                // Back-date the arrival by the time its own flow needed for the excess
+                PrimeLine &ln = lines[first];
+                float gps = speedK * flowModelSlotRate(ln.slot, nOpen) * flowModelGramsPerOz(ln.slot);
+                uint32_t back = gps > 0.0f ? (uint32_t)(excess / gps * 1000.0f) : 0;
+                ln.arrivedAt = (tMs > ln.openAt + back) ? tMs - back : ln.openAt + 1;
+                expectG += excess;
+                primeModelRecord(ln.slot, meanOpen(ln, tMs), ln.arrivedAt - ln.openAt);
+                ++learned;
         }
+        primeModelSave();
+        Serial.printf("[LOAD] Primed in %u ms (%u arrivals learned)\n", (unsigned)(millis() - t0), (unsigned)learned);
 
         // Stop pump and close outlets
-        dcPumpOff();
-        dcOutletAllOff();
+        dcApplyActuators(0);
 
-        sendData(MAINTENANCE_TOPIC, "{\"status\":\"ok\",\"action\":\"LOAD_INGREDIENTS\"}");
+        cleanPolicyMarkResidue((uint32_t)actSlotBits(reached)); // every opened line ran through the spout path
+        if (maintCancelled()) { maintFinishCancelled("LOAD_INGREDIENTS"); return; }
+        sendData(MAINTENANCE_TOPIC, refused ? "{\"status\":\"fail\",\"action\":\"LOAD_INGREDIENTS\",\"error\":\"interlock\"}"
+                                            : "{\"status\":\"ok\",\"action\":\"LOAD_INGREDIENTS\"}");
         setState(State::IDLE);
         ledIdle();
         Serial.println("→ State set to IDLE after LOAD_INGREDIENTS");
-        vTaskDelete(nullptr);
 }
 
 static void emptySystemTask(void *param) {
-    // "Empty System" / backflow: open 1..12 together and push contents back
+    // "Empty System" / backflow: open 1..N together and push contents back
     setState(State::MAINTENANCE);
     fadeToRed();
     Serial.println("→ State set to MAINTENANCE (EMPTY_SYSTEM)");
@@ -321,40 +502,26 @@ static void emptySystemTask(void *param) {
     // Baseline safe
     cleanupDrinkController();
 
-    // Output routing for backflow: OUT1=OFF, OUT2=ON, OUT3=OFF, OUT4=ON
-    dcOutletSetState(false, true, false, true);
+    // Backflow to trash (OUT2 + OUT4) with water, trash/air and every ingredient
+    // line (1..N) open together, pump on for the configured time
+    bool applied = dcApplyActuators(ACT_ROUTE_TRASH | ACT_WATER | ACT_AIR | fittedIngredients() | ACT_PUMP);
+    bool done = applied && maintWait(EMPTY_SYSTEM_MS);
 
-    // Ensure WATER and TRASH/AIR are OPEN during empty
-    dcSetSpiSlot(13, true);
-    dcSetSpiSlot(14, true);
-
-    // Open all ingredient slots (1..N) together
-    const uint8_t maxIngr = dcGetIngredientCount();
-    for (uint8_t slot = 1; slot <= maxIngr; ++slot) {
-        dcSetSpiSlot(slot, true);
-    }
-
-    // Run pump for configured time
-    dcPumpOn();
-    vTaskDelay(pdMS_TO_TICKS(EMPTY_SYSTEM_MS));
-
-    // Close all ingredient slots
-    for (uint8_t slot = 1; slot <= maxIngr; ++slot) {
-        dcSetSpiSlot(slot, false);
+    // Close everything, stop pump
+    dcApplyActuators(0);
+    if (!applied) {
+        setState(State::IDLE);
+        ledIdle();
+        sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"EMPTY_SYSTEM\",\"error\":\"interlock\"}");
+        return;
     }
-    // Close specials
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-
-    // Stop pump and close outlets
-    dcPumpOff();
-    dcOutletAllOff();
+    if (!done) { maintFinishCancelled("EMPTY_SYSTEM"); return; }
 
     setState(State::IDLE);
     ledIdle();
+    cleanPolicyRecordClean();
     sendData(MAINTENANCE_TOPIC, "{\"status\":\"ok\",\"action\":\"EMPTY_SYSTEM\"}");
     Serial.println("→ State set to IDLE after EMPTY_SYSTEM");
-    vTaskDelete(nullptr);
 }
 
 // --- Task impls ---
@@ -363,54 +530,15 @@ static void quickCleanTask(void *param) {
     fadeToRed();
     Serial.println("→ State set to MAINTENANCE (QUICK_CLEAN)");
     cleanupDrinkController();
-    // STEP 1: Water forward flush to spout (outputs 1 & 3)
-    // Route to spout
-    dcOutletSetState(true, false, true, false);
-    // Open water, close trash
-    dcSetSpiSlot(13, true);
-    dcSetSpiSlot(14, false);
-    // Ingredients closed
-    for (uint8_t s = 1; s <= dcGetIngredientCount(); ++s) dcSetSpiSlot(s, false);
-    // Pump forward
-    dcPumpOn();
-    Serial.println("[QUICK_CLEAN][STEP 1] Water flush to spout");
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=ON,4=OFF], SPI: [13=ON (water),14=OFF], Ingredients 1..N=OFF");
-    Serial.printf("  - Pump ON for QUICK_CLEAN_MS=%u ms\n", (unsigned)QUICK_CLEAN_MS);
-    // Run for configured quick-clean duration
-    vTaskDelay(pdMS_TO_TICKS(QUICK_CLEAN_MS));
-
-    // STEP 2: Air purge at the top/spout path (outputs 1 & 4)
-    Serial.println("[QUICK_CLEAN][STEP 2] Air purge at top/spout");
-    // Close water; keep trash closed
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-    // Outputs: 1=ON, 2=OFF, 3=OFF, 4=ON
-    dcOutletSetState(true, false, false, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=OFF,4=ON], SPI: [13=OFF,14=OFF]");
-    Serial.printf("  - Pump ON for CLEAN_AIR_TOP_MS=%u ms\n", (unsigned)CLEAN_AIR_TOP_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_AIR_TOP_MS));
-
-    // STEP 3: Backflow to trash
-    Serial.println("[QUICK_CLEAN][STEP 3] Backflow to trash");
-    // Outputs: 1=OFF, 2=ON, 3=OFF, 4=ON
-    dcOutletSetState(false, true, false, true);
-    // Open trash/air SPI slot
-    dcSetSpiSlot(14, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=OFF,2=ON,3=OFF,4=ON], SPI: [13=OFF,14=ON]");
-    Serial.printf("  - Pump ON for CLEAN_TRASH_MS=%u ms\n", (unsigned)CLEAN_TRASH_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_TRASH_MS));
-
-    // STEP 4: Shutdown and report
-    Serial.println("[QUICK_CLEAN][STEP 4] Shutdown – closing all solenoids and stopping pump");
-    for (uint8_t s = 1; s <= 14; ++s) dcSetSpiSlot(s, false);
-    dcPumpOff();
-    dcOutletAllOff();
+    // Water flush to spout → air purge at the top → backflow to trash, then all off
+    if (!mseqRun(MSEQ_QUICK_CLEAN, cancellableRun()) && maintCancelled()) {
+        maintFinishCancelled("QUICK_CLEAN");
+        return;
+    }
     setState(State::IDLE);
     ledIdle();
+    cleanPolicyRecordClean();
     sendData(MAINTENANCE_TOPIC, "{\"status\":\"OK\",\"action\":\"QUICK_CLEAN_OK\",\"mode\":\"QUICK_CLEAN\"}");
-    vTaskDelete(nullptr);
 }
 
 // --- New async task bodies -------------------------------------------------
@@ -420,118 +548,38 @@ static void customCleanStopTask(void *param) {
     setState(State::MAINTENANCE);
     fadeToRed();
 
-    const uint8_t maxIngr = dcGetIngredientCount();
-
-    // STEP 1: Water forward flush to clear the selected line remnants
-    Serial.println("[CUSTOM_CLEAN][STEP 1] Water flush");
-    // Close all ingredient slots 1..N
-    for (uint8_t s = 1; s <= maxIngr; ++s) dcSetSpiSlot(s, false);
-    // Specials: 13 (water)=ON, 14 (trash/air)=OFF
-    dcSetSpiSlot(13, true);
-    dcSetSpiSlot(14, false);
-    // Outputs: 1=ON, 2=OFF, 3=ON, 4=OFF (route to spout)
-    dcOutletSetState(true, false, true, false);
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=ON,4=OFF], SPI: [13=ON (water),14=OFF], Ingredients 1..N=OFF");
-    // Pump forward
-    dcPumpOn();
-    Serial.printf("  - Pump ON for CLEAN_WATER_MS=%u ms\n", (unsigned)CLEAN_WATER_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_WATER_MS));
-
-    // STEP 2: Air purge at the top/spout path (1 & 4)
-    Serial.println("[CUSTOM_CLEAN][STEP 2] Air purge at top/spout");
-    // Close water; keep trash closed
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-    // Outputs: 1=ON, 2=OFF, 3=OFF, 4=ON
-    dcOutletSetState(true, false, false, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=OFF,4=ON], SPI: [13=OFF,14=OFF]");
-    Serial.printf("  - Pump ON for CLEAN_AIR_TOP_MS=%u ms\n", (unsigned)CLEAN_AIR_TOP_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_AIR_TOP_MS));
-
-    // STEP 3: Backflow to trash
-    Serial.println("[CUSTOM_CLEAN][STEP 3] Backflow to trash");
-    // Outputs: 1=OFF, 2=ON, 3=OFF, 4=ON
-    dcOutletSetState(false, true, false, true);
-    // Open trash/air SPI slot
-    dcSetSpiSlot(14, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=OFF,2=ON,3=OFF,4=ON], SPI: [13=OFF,14=ON]");
-    Serial.printf("  - Pump ON for CLEAN_TRASH_MS=%u ms\n", (unsigned)CLEAN_TRASH_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_TRASH_MS));
-
-    // STEP 4: Shutdown and report
-    Serial.println("[CUSTOM_CLEAN][STEP 4] Shutdown – closing all solenoids and stopping pump");
-    for (uint8_t s = 1; s <= 14; ++s) dcSetSpiSlot(s, false);
-    dcPumpOff();
-    dcOutletAllOff();
+    // Water flush to clear the selected line remnants → air purge at the top →
+    // backflow to trash, then all off
+    bool cancelled = !mseqRun(MSEQ_FULL_CLEAN, cancellableRun()) && maintCancelled();
+    customActive = false;
+    if (cancelled) { maintFinishCancelled("CUSTOM_CLEAN"); return; }
     setState(State::IDLE);
     ledIdle();
-    customActive = false;
     uint8_t slot = customSlot.load();
     uint8_t phase = customPhase.load();
     char buf[160];
     snprintf(buf, sizeof(buf), "{\"status\":\"OK\",\"action\":\"CUSTOM_CLEAN_OK\",\"mode\":\"CUSTOM_CLEAN\",\"op\":\"STOP\",\"slot\":%u,\"phase\":%u}", (unsigned)slot, (unsigned)phase);
     sendData(MAINTENANCE_TOPIC, String(buf));
-    vTaskDelete(nullptr);
 }
 
 static void deepCleanFinalFlushTask(void *param) {
     if (getCurrentState() != State::IDLE) {
         Serial.println("✖ Cannot start DEEP_CLEAN_FINAL: System not IDLE");
         sendData(MAINTENANCE_TOPIC, "{\"status\":\"fail\",\"action\":\"DEEP_CLEAN_FINAL\",\"error\":\"busy\"}");
-        vTaskDelete(nullptr);
         return;
     }
     setState(State::MAINTENANCE);
     fadeToRed();
     cleanupDrinkController();
-    // STEP 1: Water forward flush to spout (outputs 1 & 3), ingredients closed, water open
-    Serial.println("[DEEP_CLEAN_FINAL][STEP 1] Water flush to spout");
-    // Route to spout
-    dcOutletSetState(true, false, true, false);
-    // Close ingredients 1..N
-    for (uint8_t s = 1; s <= dcGetIngredientCount(); ++s) dcSetSpiSlot(s, false);
-    // Open water, close trash/air
-    dcSetSpiSlot(13, true);
-    dcSetSpiSlot(14, false);
-    // Pump forward
-    dcPumpOn();
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=ON,4=OFF], SPI: [13=ON (water),14=OFF], Ingredients 1..N=OFF");
-    Serial.printf("  - Pump ON for CLEAN_WATER_MS=%u ms\n", (unsigned)CLEAN_WATER_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_WATER_MS));
-
-    // STEP 2: Air purge at the top/spout path (outputs 1 & 4); water OFF
-    Serial.println("[DEEP_CLEAN_FINAL][STEP 2] Air purge at top/spout");
-    dcSetSpiSlot(13, false); // close water
-    dcSetSpiSlot(14, false); // keep trash closed for this step
-    // Outputs: 1=ON,2=OFF,3=OFF,4=ON
-    dcOutletSetState(true, false, false, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=ON,2=OFF,3=OFF,4=ON], SPI: [13=OFF,14=OFF]");
-    Serial.printf("  - Pump ON for CLEAN_AIR_TOP_MS=%u ms\n", (unsigned)CLEAN_AIR_TOP_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_AIR_TOP_MS));
-
-    // STEP 3: Backflow to trash (outputs 2 & 4), open trash/air valve; water OFF
-    Serial.println("[DEEP_CLEAN_FINAL][STEP 3] Backflow to trash");
-    // Outputs: 1=OFF, 2=ON, 3=OFF, 4=ON
-    dcOutletSetState(false, true, false, true);
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, true);
-    // Pump continues running
-    Serial.println("  - Outputs: [1=OFF,2=ON,3=OFF,4=ON], SPI: [13=OFF,14=ON]");
-    Serial.printf("  - Pump ON for CLEAN_TRASH_MS=%u ms\n", (unsigned)CLEAN_TRASH_MS);
-    vTaskDelay(pdMS_TO_TICKS(CLEAN_TRASH_MS));
-
-    // STEP 4: Shutdown
-    Serial.println("[DEEP_CLEAN_FINAL][STEP 4] Shutdown – closing all solenoids and stopping pump");
-    for (uint8_t s = 1; s <= 14; ++s) dcSetSpiSlot(s, false);
-    dcPumpOff();
-    dcOutletAllOff();
+    // Water flush to spout → air purge at the top → backflow to trash, then all off
+    if (!mseqRun(MSEQ_FULL_CLEAN, cancellableRun()) && maintCancelled()) {
+        maintFinishCancelled("DEEP_CLEAN_FINAL");
+        return;
+    }
     setState(State::IDLE);
     ledIdle();
+    cleanPolicyRecordClean();
     sendData(MAINTENANCE_TOPIC, "{\"status\":\"OK\",\"action\":\"DEEP_CLEAN_OK\",\"mode\":\"DEEP_CLEAN_FINAL\",\"op\":\"FINAL\"}");
-    vTaskDelete(nullptr);
 }
 
 // --- Calibration mode functions ---
@@ -550,25 +598,9 @@ void startCalibrationMode(int solenoids) {
     Serial.printf("→ State set to MAINTENANCE (CALIBRATION with %d solenoids)\n", solenoids);
     cleanupDrinkController();
 
-    // Output path: OUT1=ON, OUT2=OFF, OUT3=ON, OUT4=OFF (route to spout)
-    dcOutletSetState(true, false, true, false);
-    
-    // Ensure WATER and TRASH/AIR are OFF
-    dcSetSpiSlot(13, false);
-    dcSetSpiSlot(14, false);
-
-    // Close all ingredient slots first
-    for (uint8_t slot = 1; slot <= 12; ++slot) {
-        dcSetSpiSlot(slot, false);
-    }
-    
-    // Open the specified number of solenoids (1 through N)
-    for (int i = 1; i <= solenoids; ++i) {
-        dcSetSpiSlot(i, true);
-    }
-
-    // Start pump
-    dcPumpOn();
+    // Route to spout (OUT1 + OUT3), water and trash/air closed, slots 1..N open,
+    // pump at the pour speed the flow model is calibrated for
+    if (!applyOrIdle(ACT_ROUTE_SPOUT | (ActuatorMask)((1ul << solenoids) - 1) | ACT_PUMP, nullptr, PUMP_SPEED_POUR)) return;
 
     calibrationActive = true;
     calibrationSolenoids = solenoids;
@@ -577,15 +609,14 @@ void startCalibrationMode(int solenoids) {
 
 void stopCalibrationMode() {
     Serial.println("[CALIBRATION] Stopping calibration mode");
-    
-    // Close all solenoids
-    for (uint8_t slot = 1; slot <= 14; ++slot) {
-        dcSetSpiSlot(slot, false);
+    if (autoCalibRunning) {
+        // AUTO_CALIBRATE shuts the hardware down and returns to IDLE itself
+        autoCalibAbort = true;
+        return;
     }
     
-    // Stop pump and close outlets
-    dcPumpOff();
-    dcOutletAllOff();
+    // Close all solenoids, stop pump and close outlets
+    dcApplyActuators(0);
     
     setState(State::IDLE);
     ledIdle();
@@ -595,3 +626,141 @@ void stopCalibrationMode() {
     
     Serial.println("→ State set to IDLE after calibration");
 }
+
+// --- Automatic flow calibration -----------------------------------------------
+void startAutoCalibration(uint32_t windowMs) {
+    if (getCurrentState() != State::IDLE) {
+        Serial.println("✖ Cannot start AUTO_CALIBRATE: System not IDLE");
+        sendData(FLOW_CALIB_TOPIC, "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"busy\"}");
+        return;
+    }
+    if (!pressurePadWeightReady()) {
+        Serial.println("✖ AUTO_CALIBRATE needs a pad weight curve (SET_PAD_WEIGHT_CURVE)");
+        sendData(FLOW_CALIB_TOPIC, "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"pad_not_calibrated\"}");
+        return;
+    }
+    if (!isCupPresent()) {
+        sendData(FLOW_CALIB_TOPIC, "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"no_container\"}");
+        return;
+    }
+    autoCalibWindowMs = windowMs ? windowMs : AUTO_CALIB_WINDOW_MS;
+    autoCalibAbort = false;
+    autoCalibRunning = true;
+    setState(State::MAINTENANCE); // claim the device before the task starts
+    if (!maintSubmit(autoCalibrationTask, "AUTO_CALIBRATE")) {
+        autoCalibRunning = false;
+        setState(State::IDLE);
+        sendData(FLOW_CALIB_TOPIC, "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"busy\"}");
+    }
+}
+
+// Sleep in short slices so STOP_CALIBRATION takes effect quickly. False = aborted.
+static bool calibWait(uint32_t ms) {
+    while (ms > 0) {
+        if (autoCalibAbort) return false;
+        uint32_t step = ms > 50 ? 50 : ms;
+        vTaskDelay(pdMS_TO_TICKS(step));
+        ms -= step;
+    }
+    return !autoCalibAbort;
+}
+
+// Least squares y = a + b·x. Returns the sum of squared residuals.
+static float fitLine(const float *x, const float *y, int n, float &a, float &b) {
+    float sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < n; ++i) { sx += x[i]; sy += y[i]; sxx += x[i] * x[i]; sxy += x[i] * y[i]; }
+    float den = n * sxx - sx * sx;
+    b = (fabsf(den) > 1e-9f) ? (n * sxy - sx * sy) / den : 0.0f;
+    a = (sy - b * sx) / n;
+    float sse = 0;
+    for (int i = 0; i < n; ++i) { float r = y[i] - (a + b * x[i]); sse += r * r; }
+    return sse;
+}
+
+static void autoCalibrationTask(void *param) {
+    fadeToRed();
+    Serial.println("→ State set to MAINTENANCE (AUTO_CALIBRATE)");
+    cleanupDrinkController();
+    flowModelRefresh();
+
+    const int runs = dcGetIngredientCount() < 5 ? dcGetIngredientCount() : 5;
+    float ratesLps[5] = {0};
+    bool ok = runs >= 2;
+
+    // Route to spout (OUT1 & OUT3), specials closed
+    bool refused = !dcApplyActuators(ACT_ROUTE_SPOUT);
+
+    for (int n = 1; ok && !refused && n <= runs; ++n) {
+        // Open slots 1..n (same lines as manual START_CALIBRATION) at the calibration
+        // speed = nominal pour speed
+        if (!dcApplyActuators(ACT_ROUTE_SPOUT | (ActuatorMask)((1ul << n) - 1) | ACT_PUMP, PUMP_SPEED_POUR)) { refused = true; break; }
+        if (!calibWait(AUTO_CALIB_SETTLE_MS)) { ok = false; break; }
+        float g0 = pressurePadGrams();
+        unsigned long t0 = millis();
+        if (!calibWait(autoCalibWindowMs)) { ok = false; break; }
+        float g1 = pressurePadGrams();
+        float sec = (millis() - t0) / 1000.0f;
+        if (!dcApplyActuators(ACT_ROUTE_SPOUT)) { refused = true; break; }
+
+        // g/s → mL/s with the lines' densities, then divide out the per-slot
+        // multipliers so the stored curve is the bare pump curve
+        float gPerMl = 0.0f, kSum = 0.0f;
+        for (int s = 1; s <= n; ++s) {
+            gPerMl += flowModelGramsPerOz(s) / 29.5735f;
+            kSum   += flowModelSlotRate(s, n) / (flowModelTotalRate(n) / n);
+        }
+        gPerMl /= n;
+        float kMean = (kSum > 0.0f) ? kSum / n : 1.0f;
+        float mlps = (sec > 0.0f && gPerMl > 0.0f) ? (g1 - g0) / sec / gPerMl : 0.0f;
+        ratesLps[n - 1] = mlps / 1000.0f / kMean;
+        Serial.printf("[AUTO_CALIB] %d valve(s): %.1f g in %.2f s → %.4f L/s\n", n, g1 - g0, sec, ratesLps[n - 1]);
+        if (ratesLps[n - 1] <= 0.0f) { ok = false; break; }
+        {
+            char buf[112];
+            snprintf(buf, sizeof(buf), "{\"action\":\"AUTO_CALIBRATION_STEP\",\"solenoids\":%d,\"rate_lps\":%.5f}", n, ratesLps[n - 1]);
+            sendData(FLOW_CALIB_TOPIC, String(buf));
+        }
+        if (!calibWait(AUTO_CALIB_GAP_MS)) { ok = false; break; }
+    }
+
+    // Safe state regardless of outcome
+    dcApplyActuators(0);
+
+    if (ok && !refused) {
+        // Fit both models over n = 1..runs and keep the one with the smaller residual
+        float xs[5], xl[5];
+        for (int i = 0; i < runs; ++i) { xs[i] = (float)(i + 1); xl[i] = logf((float)(i + 1)); }
+        float linA, linB, logA, logB;
+        float linSse = fitLine(xs, ratesLps, runs, linA, linB);
+        float logSse = fitLine(xl, ratesLps, runs, logA, logB);
+        bool useLog = logSse < linSse;
+        const char *fit = useLog ? "log" : "linear";
+        float a = useLog ? logA : linA, b = useLog ? logB : linB;
+        saveFlowCalibrationToNVS(ratesLps, runs, fit, a, b);
+        Serial.printf("[AUTO_CALIB] Saved %d rates, fit=%s a=%.5f b=%.5f (sse lin=%.3g log=%.3g)\n",
+                      runs, fit, a, b, linSse, logSse);
+
+        JsonDocument resp;
+        resp["action"] = "AUTO_CALIBRATION_DONE";
+        JsonArray arr = resp.createNestedArray("rates_lps");
+        for (int i = 0; i < runs; ++i) arr.add(ratesLps[i]);
+        JsonObject f = resp.createNestedObject("fit");
+        f["type"] = fit;
+        f["a"] = a;
+        f["b"] = b;
+        resp["sse_linear"] = linSse;
+        resp["sse_log"] = logSse;
+        String out; serializeJson(resp, out);
+        sendData(FLOW_CALIB_TOPIC, out);
+    } else {
+        Serial.println("[AUTO_CALIB] Aborted – calibration unchanged");
+        sendData(FLOW_CALIB_TOPIC, refused        ? "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"interlock\"}"
+                                 : autoCalibAbort ? "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"aborted\"}"
+                                                  : "{\"action\":\"AUTO_CALIBRATION_FAILED\",\"error\":\"no_flow\"}");
+    }
+
+    autoCalibRunning = false;
+    setState(State::IDLE);
+    ledIdle();
+    Serial.println("→ State set to IDLE after AUTO_CALIBRATE");
+}
@@ -0,0 +1,213 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: order_queue.cpp
+ *  Description: Fixed-capacity ring of pending drink orders (no heap). Start
+ *               times are predicted from the running pour's remaining time plus
+ *               the ETA of every order ahead. On dual-station builds the head
+ *               order is paired with a queued order whose cup waits on station
+ *               B; it pours right after the head, with no cup round trip (the
+ *               stations share the manifold – pour_resources.h).
+ * -----------------------------------------------------------------------------
+ */
+
+#include "order_queue.h"
+#include "drink_controller.h"   // dcReserveStock(), startPourTask(), estimateDrinkTime()
+#include "aws_manager.h"        // publishDeferred(), AWS_RECEIVE_TOPIC
+#include "state_manager.h"
+#include "pressure_pad.h"
+#include "pin_config.h"         // ORDER_QUEUE_CAP, ORDER_CMD_MAX, ORDER_QUEUE_CUP_WAIT_MS, POUR_STATIONS
+
+struct QueuedOrder {
+    uint16_t id;
+    char     cmd[ORDER_CMD_MAX];
+    bool     overrideNoCup;
+    uint8_t  progressHz;
+    uint8_t  count;
+    float    durationSec;   // ETA × count when queued
+};
+
+static QueuedOrder   s_q[ORDER_QUEUE_CAP];
+static uint8_t       s_head = 0, s_len = 0;
+static uint16_t      s_nextId = 1;
+static bool          s_needLift = true;     // cup on the pad may be the last guest's drink
+static unsigned long s_headSinceMs = 0;     // head became startable (device IDLE); 0 = not yet
+
+static QueuedOrder &at(uint8_t i) { return s_q[(s_head + i) % ORDER_QUEUE_CAP]; }
+
+#if POUR_STATIONS > 1
+static bool        s_needLiftB = true;   // same for station B's pad
+static QueuedOrder s_nextB;              // paired with the pour on A, starts on B after it
+static bool        s_haveNextB = false;
+
+// First order behind the head that can wait on station B while the head pours: a
+// single, cup-guarded drink. -1 if none. Pours never overlap here (one pump and
+// manifold – pour_resources.h), so pairing saves the cup round trip, not pour time.
+static int8_t pickCompanion(const QueuedOrder &head) {
+    if (head.count != 1 || head.overrideNoCup) return -1;
+    for (uint8_t i = 1; i < s_len; ++i) {
+        const QueuedOrder &o = at(i);
+        if (o.count == 1 && !o.overrideNoCup) return (int8_t)i;
+    }
+    return -1;
+}
+
+// Close the gap left by an order taken out of the middle (i ≥ 1)
+static void removeAt(uint8_t i) {
+    for (uint8_t k = i; k + 1 < s_len; ++k) at(k) = at(k + 1);
+    --s_len;
+}
+#endif
+
+// Orders ahead of the queue proper: the one paired on station B
+static uint8_t pairedWaiting() {
+#if POUR_STATIONS > 1
+    return s_haveNextB ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+// Seconds until the order at index i starts, if every cup arrives on time
+static float startInSec(uint8_t i) {
+    float t = dcPourSecondsLeft();
+#if POUR_STATIONS > 1
+    if (s_haveNextB) t += s_nextB.durationSec;
+#endif
+    for (uint8_t k = 0; k < i; ++k) t += at(k).durationSec;
+    return t;
+}
+
+OrderQueueStatus orderQueuePush(const char *cmd, bool overrideNoCup, uint8_t progressHz,
+                                uint8_t count, OrderTicket &ticket) {
+    if (s_len >= ORDER_QUEUE_CAP) return OQ_FULL;
+    if (!cmd || strlen(cmd) >= ORDER_CMD_MAX) return OQ_INVALID;
+    float eta = estimateDrinkTime(cmd);
+    if (eta < 0.0f) return OQ_INVALID;
+    int held = dcReserveStock(cmd, count);
+    if (held < 0) return OQ_INVALID;
+    if (held == 0) return OQ_NO_STOCK;
+
+    QueuedOrder &o = at(s_len);
+    o.id = s_nextId++;
+    if (!s_nextId) s_nextId = 1;
+    strncpy(o.cmd, cmd, sizeof(o.cmd));
+    o.cmd[sizeof(o.cmd) - 1] = '\0';
+    o.overrideNoCup = overrideNoCup;
+    o.progressHz    = progressHz;
+    o.count         = count;
+    o.durationSec   = eta * count;
+
+    ticket.id         = o.id;
+    ticket.position   = pairedWaiting() + s_len + 1;
+    ticket.startInSec = startInSec(s_len);
+    ++s_len;
+    Serial.printf("[QUEUE] Order %u queued at position %u (starts in ~%.0f s): %s\n",
+                  (unsigned)ticket.id, (unsigned)ticket.position, ticket.startInSec, o.cmd);
+    return OQ_QUEUED;
+}
+
+uint8_t orderQueueLength() { return pairedWaiting() + s_len; }
+
+// station (1-based) on dual-station builds
+static void publishStart(uint16_t id, uint8_t station) {
+    char msg[80];
+    if (station) snprintf(msg, sizeof(msg), "{\"status\":\"order_start\",\"order_id\":%u,\"station\":%u}", (unsigned)id, (unsigned)station);
+    else         snprintf(msg, sizeof(msg), "{\"status\":\"order_start\",\"order_id\":%u}", (unsigned)id);
+    publishDeferred(AWS_RECEIVE_TOPIC, msg);
+}
+
+void orderQueueService() {
+    if (!isIdle()) {
+        s_needLift = true;
+        s_headSinceMs = 0;
+#if POUR_STATIONS > 1
+        s_needLiftB = true;
+#endif
+        return;
+    }
+    if (!isCupPresent()) s_needLift = false;
+#if POUR_STATIONS > 1
+    if (!isCupPresentAt(1)) s_needLiftB = false;
+    if (s_haveNextB) {
+        // Its cup has been on pad B since the pair was taken; the pour task waits
+        // for it if it was lifted in the meantime
+        s_haveNextB = false;
+        Serial.printf("[QUEUE] Starting order %u on station B (%u left in queue)\n", (unsigned)s_nextB.id, (unsigned)s_len);
+        setState(State::POURING);
+        publishStart(s_nextB.id, 2);
+        startPourTask(s_nextB.cmd, false, s_nextB.progressHz, 0, 1, 1);
+        return;
+    }
+#endif
+    if (!s_len) return;
+
+    QueuedOrder &o = at(0);
+    char msg[96];
+    if (!s_headSinceMs) {
+        s_headSinceMs = millis();
+        snprintf(msg, sizeof(msg), "{\"status\":\"order_next\",\"order_id\":%u}", (unsigned)o.id);
+        publishDeferred(AWS_RECEIVE_TOPIC, msg);
+    }
+    bool cupReady = o.overrideNoCup || (!s_needLift && isCupPresent());
+    if (!cupReady) {
+        if ((millis() - s_headSinceMs) > ORDER_QUEUE_CUP_WAIT_MS) {
+            Serial.printf("[QUEUE] Order %u dropped – no cup within %lu s\n",
+                          (unsigned)o.id, (unsigned long)(ORDER_QUEUE_CUP_WAIT_MS / 1000));
+            snprintf(msg, sizeof(msg), "{\"status\":\"order_dropped\",\"order_id\":%u,\"error\":\"no_cup\"}", (unsigned)o.id);
+            publishDeferred(AWS_RECEIVE_TOPIC, msg);
+            dcReleaseStock(o.cmd, o.count);
+            s_head = (s_head + 1) % ORDER_QUEUE_CAP;
+            --s_len;
+            s_headSinceMs = 0;
+        }
+        return;
+    }
+
+    // Fresh cup on the pad: start straight away (stock is already reserved)
+    QueuedOrder run = o;
+#if POUR_STATIONS > 1
+    // A fresh cup on station B too: an order waits there and pours right after this one
+    int8_t ci = (!s_needLiftB && isCupPresentAt(1)) ? pickCompanion(run) : -1;
+    if (ci > 0) {
+        s_nextB = at((uint8_t)ci);
+        s_haveNextB = true;
+        removeAt((uint8_t)ci);
+        s_needLiftB = true;
+    }
+#endif
+    s_head = (s_head + 1) % ORDER_QUEUE_CAP;
+    --s_len;
+    s_headSinceMs = 0;
+    s_needLift = true;
+    Serial.printf("[QUEUE] Starting order %u (%u left in queue)\n", (unsigned)run.id, (unsigned)s_len);
+    setState(State::POURING);
+#if POUR_STATIONS > 1
+    if (ci > 0) Serial.printf("[QUEUE] Order %u waits on station B and pours next\n", (unsigned)s_nextB.id);
+    publishStart(run.id, 1);
+#else
+    publishStart(run.id, 0);
+#endif
+    startPourTask(run.cmd, run.overrideNoCup, run.progressHz, 0, run.count);
+}
+
+void orderQueueToJson(JsonObject out) {
+    JsonArray arr = out.createNestedArray("orders");
+#if POUR_STATIONS > 1
+    if (s_haveNextB) {
+        JsonObject o = arr.add<JsonObject>();
+        o["order_id"] = s_nextB.id;
+        o["position"] = 1;
+        o["count"]    = 1;
+        o["start_in"] = dcPourSecondsLeft();
+        o["station"]  = 2;
+    }
+#endif
+    for (uint8_t i = 0; i < s_len; ++i) {
+        JsonObject o = arr.add<JsonObject>();
+        o["order_id"] = at(i).id;
+        o["position"] = pairedWaiting() + i + 1;
+        o["count"]    = at(i).count;
+        o["start_in"] = startInSec(i);
+    }
+}
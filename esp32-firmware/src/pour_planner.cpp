@@ -0,0 +1,130 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: pour_planner.cpp
+ *  Description: Closed-form timeline for a priority group. Up to `maxOpen`
+ *               valves run at once; the valve with the least time left closes
+ *               first, the next waiting valve opens in its place and the share
+ *               of the pump is recomputed. No ticks, so there is no per-step
+ *               overshoot or drift. planGroupMinMakespan() tries every cap and
+ *               keeps the shortest plan, because total flow saturates after a
+ *               few open valves (flowRate(n) is strongly sublinear).
+ * -----------------------------------------------------------------------------
+ */
+
+#include "pour_planner.h"
+
+bool planParallelGroup(const IngredientCommand *group, size_t n, SlotFlowFn flow, PourPlan &plan,
+                       uint8_t maxOpen) {
+    plan.count = 0;
+    plan.makespanUs = 0;
+    plan.maxOpen = 0;
+    if (!group || !flow) return false;
+
+    struct Job { int slot; float ozLeft; };
+    Job wait[PLAN_MAX_SLOTS];
+    uint8_t nWait = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (group[i].amount <= 0.0f) continue;
+        if (nWait >= PLAN_MAX_SLOTS) return false;
+        // Insert sorted by amount, largest first (stable for equal amounts)
+        uint8_t k = nWait++;
+        while (k > 0 && wait[k - 1].ozLeft < group[i].amount) { wait[k] = wait[k - 1]; --k; }
+        wait[k] = { group[i].slot, group[i].amount };
+    }
+    if (maxOpen == 0 || maxOpen > nWait) maxOpen = nWait;
+    plan.maxOpen = maxOpen;
+
+    Job act[PLAN_MAX_SLOTS];
+    uint8_t nAct = 0, nextWait = 0;
+    double tSec = 0.0;
+    uint32_t atUs = 0;
+    while (true) {
+        // Fill free valve positions from the waiting list at the current instant
+        while (nAct < maxOpen && nextWait < nWait) {
+            act[nAct++] = wait[nextWait];
+            plan.events[plan.count++] = { atUs, (uint8_t)wait[nextWait].slot, true };
+            ++nextWait;
+        }
+        if (nAct == 0) break;
+
+        // Time until the first active valve reaches its target at the current share
+        float rate[PLAN_MAX_SLOTS];
+        double dt = -1.0;
+        for (uint8_t i = 0; i < nAct; ++i) {
+            rate[i] = flow(act[i].slot, nAct);
+            if (rate[i] <= 0.0f) { plan.count = 0; return false; }
+            double t = act[i].ozLeft / rate[i];
+            if (dt < 0.0 || t < dt) dt = t;
+        }
+        tSec += dt;
+        atUs = (uint32_t)(tSec * 1e6 + 0.5);
+
+        // Advance everyone by dt; close every valve that is now done (ties close together)
+        uint8_t keep = 0;
+        for (uint8_t i = 0; i < nAct; ++i) {
+            float left = act[i].ozLeft - (float)(rate[i] * dt);
+            if (left <= 1e-4f) {
+                plan.events[plan.count++] = { atUs, (uint8_t)act[i].slot, false };
+            } else {
+                act[keep++] = { act[i].slot, left };
+            }
+        }
+        nAct = keep;
+        plan.makespanUs = atUs;
+    }
+    return true;
+}
+
+bool planGroupMinMakespan(const IngredientCommand *group, size_t n, SlotFlowFn flow, PourPlan &plan) {
+    PourPlan trial;
+    bool have = false;
+    size_t limit = n < PLAN_MAX_SLOTS ? n : PLAN_MAX_SLOTS;
+    for (uint8_t cap = 1; cap <= limit; ++cap) {
+        if (!planParallelGroup(group, n, flow, trial, cap)) continue;
+        if (!have || trial.makespanUs < plan.makespanUs * (1.0f - PLAN_CAP_GAIN)) {
+            plan = trial;
+            have = true;
+        }
+        if (trial.maxOpen < cap) break; // fewer jobs than the cap – larger caps are identical
+    }
+    return have;
+}
+
+void planMassProfile(const PourPlan &plan, SlotFlowFn flow, SlotGramsFn gramsPerOz, float *gramsAtEvent) {
+    uint8_t open[PLAN_MAX_SLOTS];
+    uint8_t nOpen = 0;
+    float   mass = 0.0f;
+    uint32_t lastUs = 0;
+    for (uint8_t e = 0; e < plan.count; ++e) {
+        const ValveEvent &ev = plan.events[e];
+        if (ev.atUs > lastUs && nOpen > 0) {
+            // Everything open since lastUs flowed at the share for nOpen valves
+            float gps = 0.0f;
+            for (uint8_t i = 0; i < nOpen; ++i) gps += flow(open[i], nOpen) * gramsPerOz(open[i]);
+            mass += gps * (ev.atUs - lastUs) / 1e6f;
+        }
+        lastUs = ev.atUs;
+        if (ev.open) {
+            if (nOpen < PLAN_MAX_SLOTS) open[nOpen++] = ev.slot;
+        } else {
+            for (uint8_t i = 0; i < nOpen; ++i) {
+                if (open[i] == ev.slot) { open[i] = open[--nOpen]; break; }
+            }
+        }
+        gramsAtEvent[e] = mass;
+    }
+}
+
+uint32_t planTimeForMass(const PourPlan &plan, const float *gramsAtEvent, float grams) {
+    if (plan.count == 0 || grams <= 0.0f) return 0;
+    for (uint8_t e = 1; e < plan.count; ++e) {
+        if (grams < gramsAtEvent[e]) {
+            float m0 = gramsAtEvent[e - 1], m1 = gramsAtEvent[e];
+            uint32_t t0 = plan.events[e - 1].atUs, t1 = plan.events[e].atUs;
+            if (m1 - m0 <= 0.0f) return t0;
+            return t0 + (uint32_t)((grams - m0) / (m1 - m0) * (float)(t1 - t0));
+        }
+    }
+    return plan.makespanUs;
+}
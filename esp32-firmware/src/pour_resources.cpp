@@ -0,0 +1,30 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: pour_resources.cpp
+ *  Description: Station table: outlet routes for pouring and the top purge.
+ * -----------------------------------------------------------------------------
+ */
+
+#include "pour_resources.h"
+
+struct StationDef {
+    uint8_t pourOuts;
+    uint8_t purgeOuts;
+};
+
+static const StationDef STATIONS[] = {
+    { STATION_A_POUR_OUTS, STATION_A_PURGE_OUTS },
+#if POUR_STATIONS > 1
+    { STATION_B_POUR_OUTS, STATION_B_PURGE_OUTS },
+#endif
+};
+static constexpr uint8_t STATION_COUNT = sizeof(STATIONS) / sizeof(STATIONS[0]);
+
+uint8_t prPourOutlets(uint8_t station) {
+    return station < STATION_COUNT ? STATIONS[station].pourOuts : 0;
+}
+
+uint8_t prPurgeOutlets(uint8_t station) {
+    return station < STATION_COUNT ? STATIONS[station].purgeOuts : 0;
+}
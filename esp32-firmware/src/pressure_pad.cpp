@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <math.h>
+#include <Preferences.h>
 #include "pressure_pad.h"
 #include "pin_config.h"
 
@@ -12,6 +13,14 @@ static volatile unsigned long s_lastEdgeMs = 0;
 static volatile bool     s_polarityLowers = true; // true: cup lowers ADC; false: cup raises ADC
 static volatile bool     s_baselineLocked = true; // true: baseline does not adapt during session
 
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+// Station B pad: presence only (same thresholds/polarity; weighing is station A's)
+static volatile float    s_filtB = 0.0f;
+static volatile float    s_baseB = 0.0f;
+static volatile bool     s_presentB = false;
+static volatile unsigned long s_lastEdgeMsB = 0;
+#endif
+
 // Tunables (can be overridden via setters)
 static float    kEmaAlpha = 0.2f;           // filter for raw -> filtered
 static float    kBaseAlpha = 0.01f;         // slow baseline tracker when not present (used only if unlocked)
@@ -40,6 +49,49 @@ static uint16_t kSampleMs        = 20;      // sampling period (~50 Hz)
 
 static TaskHandle_t s_task = nullptr;
 
+// Weight estimation
+static volatile float s_tare = 0.0f;                 // filtered reading at tare
+// Replaced from the MQTT loop while the pour task interpolates over it: built
+// in a local copy and swapped in whole under s_curveMux; readers copy it out.
+struct PadCurve {
+    float   counts[PAD_WEIGHT_MAX_POINTS];
+    float   grams[PAD_WEIGHT_MAX_POINTS];
+    uint8_t n;
+    bool    enabled;
+};
+static PadCurve     s_curve = {};
+static portMUX_TYPE s_curveMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void publishCurve(const PadCurve &c) {
+    portENTER_CRITICAL(&s_curveMux);
+    s_curve = c;
+    portEXIT_CRITICAL(&s_curveMux);
+}
+
+static PadCurve copyCurve() {
+    portENTER_CRITICAL(&s_curveMux);
+    PadCurve c = s_curve;
+    portEXIT_CRITICAL(&s_curveMux);
+    return c;
+}
+
+static void loadWeightCurve() {
+    Preferences p;
+    if (!p.begin("padcal", true)) return;
+    PadCurve c = {};
+    uint8_t n = p.getUChar("n", 0);
+    if (n > PAD_WEIGHT_MAX_POINTS) n = 0;
+    for (uint8_t i = 0; i < n; ++i) {
+        char key[8];
+        snprintf(key, sizeof(key), "c%u", (unsigned)i); c.counts[i] = p.getFloat(key, 0);
+        snprintf(key, sizeof(key), "g%u", (unsigned)i); c.grams[i]  = p.getFloat(key, 0);
+    }
+    c.n = n;
+    c.enabled = p.getUChar("en", 1) != 0;
+    p.end();
+    publishCurve(c);
+}
+
 static uint16_t readADC() {
 #if defined(PRESSURE_ADC_PIN)
     int v = analogRead(PRESSURE_ADC_PIN); // 12-bit on ESP32 (0..4095)
@@ -50,6 +102,42 @@ static uint16_t readADC() {
 #endif
 }
 
+// Presence decision with hysteresis + debounce (one-sided by polarity). Returns
+// the new state; tracks the baseline while empty when unlocked.
+static bool presenceStep(float filt, volatile float &base, bool present, volatile unsigned long &lastEdgeMs) {
+    float pct = 0.0f; // magnitude in the configured direction
+    if (base > 1.0f) {
+        float delta = filt - base;
+        // We look only in the chosen direction to avoid inverted toggles
+        float dir = s_polarityLowers ? -delta : delta; // positive when in presence direction
+        if (dir > 0.0f) pct = dir / base; else pct = 0.0f;
+    }
+    unsigned long now = millis();
+    if (!present) {
+        if (pct >= kOnThresholdPct) {
+            if (now - lastEdgeMs >= kDebounceMs) { lastEdgeMs = now; return true; }
+        } else {
+            // slowly update baseline when empty (only if unlocked)
+            if (!s_baselineLocked) {
+                base = (1.0f - kBaseAlpha) * base + kBaseAlpha * filt;
+            }
+        }
+    } else {
+        if (pct <= kOffThresholdPct) {
+            if (now - lastEdgeMs >= kDebounceMs) { lastEdgeMs = now; return false; }
+        }
+    }
+    return present;
+}
+
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+static uint16_t readADCB() {
+    int v = analogRead(PRESSURE_ADC_PIN_B);
+    if (v < 0) v = 0; if (v > 4095) v = 4095;
+    return (uint16_t)v;
+}
+#endif
+
 static void samplerTask(void *arg) {
 #if defined(PRESSURE_ADC_PIN)
     // ADC setup: use ADC1 pins only to avoid WiFi interference.
@@ -66,6 +154,10 @@ static void samplerTask(void *arg) {
     s_raw = sum / seedN;
     s_filt = (float)s_raw;
     s_base = s_filt; // start equal
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+    s_filtB = (float)readADCB();
+    s_baseB = s_filtB;
+#endif
 #endif
 
     while (true) {
@@ -75,33 +167,11 @@ static void samplerTask(void *arg) {
         // EMA filter
         s_filt = (1.0f - kEmaAlpha) * s_filt + kEmaAlpha * (float)r;
 
-        // Presence decision with hysteresis + debounce (one-sided by polarity)
-        float pct = 0.0f; // magnitude in the configured direction
-        if (s_base > 1.0f) {
-            float delta = s_filt - s_base;
-            // We look only in the chosen direction to avoid inverted toggles
-            float dir = s_polarityLowers ? -delta : delta; // positive when in presence direction
-            if (dir > 0.0f) pct = dir / s_base; else pct = 0.0f;
-        }
-        bool prev = s_present;
-        bool next = s_present;
-        unsigned long now = millis();
-        if (!s_present) {
-            if (pct >= kOnThresholdPct) {
-                if (now - s_lastEdgeMs >= kDebounceMs) { next = true; s_lastEdgeMs = now; }
-            } else {
-                // slowly update baseline when empty (only if unlocked)
-                if (!s_baselineLocked) {
-                    s_base = (1.0f - kBaseAlpha) * s_base + kBaseAlpha * s_filt;
-                }
-            }
-        } else {
-            if (pct <= kOffThresholdPct) {
-                if (now - s_lastEdgeMs >= kDebounceMs) { next = false; s_lastEdgeMs = now; }
-            }
-        }
-    // Log removed
-        s_present = next;
+        s_present = presenceStep(s_filt, s_base, s_present, s_lastEdgeMs);
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+        s_filtB   = (1.0f - kEmaAlpha) * s_filtB + kEmaAlpha * (float)readADCB();
+        s_presentB = presenceStep(s_filtB, s_baseB, s_presentB, s_lastEdgeMsB);
+#endif
 #endif
         vTaskDelay(pdMS_TO_TICKS(kSampleMs));
     }
@@ -111,6 +181,10 @@ void pressurePadInit() {
 #if defined(PRESSURE_ADC_PIN)
     pinMode(PRESSURE_ADC_PIN, INPUT);
 #endif
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+    pinMode(PRESSURE_ADC_PIN_B, INPUT);
+#endif
+    loadWeightCurve();
     if (!s_task) {
         xTaskCreatePinnedToCore(samplerTask, "PadSampler", 3072, nullptr, 1, &s_task, 1);
     }
@@ -130,11 +204,24 @@ void pressurePadCalibrate(uint16_t durationMs) {
         s_filt = b; // re-center
         s_present = false;
     s_lastEdgeMs = millis();
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+        s_baseB = s_filtB; // pad B sampled by the task meanwhile; assumed empty too
+        s_presentB = false;
+        s_lastEdgeMsB = millis();
+#endif
     }
 }
 
 bool isCupPresent() { return s_present; }
 
+bool isCupPresentAt(uint8_t station) {
+    if (station == 0) return s_present;
+#if POUR_STATIONS > 1 && defined(PRESSURE_ADC_PIN_B)
+    if (station == 1) return s_presentB;
+#endif
+    return false;
+}
+
 void setPresenceThresholdPercent(float pctOn) { kOnThresholdPct = constrain(pctOn, 0.0f, 1.0f); }
 void setPresenceHysteresisPercent(float pctOff) { kOffThresholdPct = constrain(pctOff, 0.0f, 1.0f); }
 void setPresenceDebounceMs(uint16_t ms) { kDebounceMs = ms; }
@@ -157,3 +244,63 @@ float pressurePadPctOver() {
     if (dir <= 0.0f) return 0.0f;
     return dir / s_base;
 }
+
+/* ---------------------------- Weight estimation ---------------------------- */
+void pressurePadTare() { s_tare = s_filt; }
+
+float pressurePadCountsOverTare() {
+    float delta = s_filt - s_tare;
+    float dir = s_polarityLowers ? -delta : delta;
+    return dir > 0.0f ? dir : 0.0f;
+}
+
+float pressurePadGrams() {
+    const PadCurve w = copyCurve();
+    if (w.n < 2) return 0.0f;
+    float c = pressurePadCountsOverTare();
+    uint8_t seg = 1;
+    while (seg < w.n - 1 && c > w.counts[seg]) ++seg;
+    float c0 = w.counts[seg - 1], c1 = w.counts[seg];
+    if (c1 - c0 <= 0.0f) return w.grams[seg];
+    float g = w.grams[seg - 1] + (c - c0) * (w.grams[seg] - w.grams[seg - 1]) / (c1 - c0);
+    return g > 0.0f ? g : 0.0f;
+}
+
+bool pressurePadWeightReady() {
+    portENTER_CRITICAL(&s_curveMux);
+    bool ready = s_curve.enabled && s_curve.n >= 2;
+    portEXIT_CRITICAL(&s_curveMux);
+    return ready;
+}
+
+bool setPadWeightCurve(const float *counts, const float *grams, uint8_t n, bool enabled) {
+    if (n > PAD_WEIGHT_MAX_POINTS) return false;
+    for (uint8_t i = 1; i < n; ++i) {
+        if (counts[i] <= counts[i - 1]) return false; // must be strictly increasing
+    }
+    PadCurve c = {};
+    Preferences p;
+    if (!p.begin("padcal", false)) return false;
+    p.putUChar("n", n);
+    p.putUChar("en", enabled ? 1 : 0);
+    for (uint8_t i = 0; i < n; ++i) {
+        char key[8];
+        snprintf(key, sizeof(key), "c%u", (unsigned)i); p.putFloat(key, counts[i]);
+        snprintf(key, sizeof(key), "g%u", (unsigned)i); p.putFloat(key, grams[i]);
+        c.counts[i] = counts[i];
+        c.grams[i]  = grams[i];
+    }
+    p.end();
+    c.n = n;
+    c.enabled = enabled;
+    publishCurve(c);   // points, count and flag change together
+    return true;
+}
+
+uint8_t getPadWeightCurve(float *counts, float *grams, uint8_t maxN, bool &enabled) {
+    const PadCurve w = copyCurve();
+    uint8_t n = w.n < maxN ? w.n : maxN;
+    for (uint8_t i = 0; i < n; ++i) { counts[i] = w.counts[i]; grams[i] = w.grams[i]; }
+    enabled = w.enabled;
+    return n;
+}
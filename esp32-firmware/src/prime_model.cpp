@@ -0,0 +1,225 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: prime_model.cpp
+ *  Description: Per-line prime times and the READY_SYSTEM group plan. Learned
+ *               on the maintenance worker, read from the MQTT loop, so every
+ *               access goes through a spinlock; NVS is only touched outside it.
+ *               Flow-model reads and the plan run under dcPlanLock(), like the
+ *               pour planner's.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <Preferences.h>
+#include "prime_model.h"
+#include "flow_model.h"        // flowModelRefresh(), flowModelSlotRate()
+#include "drink_controller.h"  // dcGetIngredientCount(), dcPlanLock()
+#include "board_profile.h"     // BOARD_INGREDIENT_SLOTS
+#include "pin_config.h"        // PRIME_*
+
+static constexpr uint8_t PRIME_NVS_VERSION = 1;
+
+// Stored as one blob in NVS – bump PRIME_NVS_VERSION when the layout changes.
+// Sized by the board profile, so a blob saved under another profile is ignored.
+struct PrimeState {
+    uint8_t  version;
+    uint8_t  board;
+    uint8_t  samples[BOARD_INGREDIENT_SLOTS];  // saturates at 255
+    uint16_t ms[BOARD_INGREDIENT_SLOTS];       // one line open
+};
+
+static PrimeState   s_prime;
+static bool         s_loaded = false;
+static bool         s_dirty = false;
+static portMUX_TYPE s_primeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void setDefaults(PrimeState &st) {
+    memset(&st, 0, sizeof(st));
+    st.version = PRIME_NVS_VERSION;
+    st.board   = BOARD_PROFILE;
+    for (uint8_t i = 0; i < BOARD_INGREDIENT_SLOTS; ++i) st.ms[i] = PRIME_DEFAULT_MS;
+}
+
+static void ensureLoaded() {
+    if (s_loaded) return;
+    PrimeState st;
+    Preferences prefs;
+    bool ok = false;
+    if (prefs.begin("primemodel", true)) {
+        ok = prefs.getBytesLength("state") == sizeof(st) &&
+             prefs.getBytes("state", &st, sizeof(st)) == sizeof(st) &&
+             st.version == PRIME_NVS_VERSION && st.board == BOARD_PROFILE;
+        prefs.end();
+    }
+    if (!ok) setDefaults(st);
+    portENTER_CRITICAL(&s_primeMux);
+    if (!s_loaded) { s_prime = st; s_loaded = true; }
+    portEXIT_CRITICAL(&s_primeMux);
+}
+
+static uint32_t singleMs(uint8_t slot) {
+    if (slot < 1 || slot > BOARD_INGREDIENT_SLOTS) return PRIME_DEFAULT_MS;
+    ensureLoaded();
+    portENTER_CRITICAL(&s_primeMux);
+    uint32_t ms = s_prime.ms[slot - 1];
+    portEXIT_CRITICAL(&s_primeMux);
+    return ms;
+}
+
+// Time with numOpen lines open ÷ time with one: the line's flow drops from
+// its single-line rate to its share of the pump
+static float openScale(uint8_t slot, uint8_t numOpen) {
+    if (numOpen <= 1) return 1.0f;
+    if (numOpen > FLOW_MAX_OPEN) numOpen = FLOW_MAX_OPEN;
+    float one = flowModelSlotRate(slot, 1), shared = flowModelSlotRate(slot, numOpen);
+    return (one > 0.0f && shared > 0.0f) ? one / shared : (float)numOpen;
+}
+
+// Mean open count of a run: interpolate between the whole counts around it
+static float openScale(uint8_t slot, float numOpen) {
+    if (numOpen <= 1.0f) return 1.0f;
+    if (numOpen >= FLOW_MAX_OPEN) return openScale(slot, (uint8_t)FLOW_MAX_OPEN);
+    uint8_t k = (uint8_t)numOpen;
+    float lo = openScale(slot, k), hi = openScale(slot, (uint8_t)(k + 1));
+    return lo + (hi - lo) * (numOpen - k);
+}
+
+// Caller holds dcPlanLock()
+static uint32_t scaledMs(uint8_t slot, uint8_t numOpen) {
+    return (uint32_t)(singleMs(slot) * openScale(slot, numOpen) + 0.5f);
+}
+
+uint32_t primeModelMs(uint8_t slot, uint8_t numOpen) {
+    dcPlanLock();
+    uint32_t ms = scaledMs(slot, numOpen);
+    dcPlanUnlock();
+    return ms;
+}
+
+// Longest-first list schedule of order[0..n-1] with k lines open: the next
+// line opens as soon as one closes
+static uint32_t makespanFor(const uint8_t *order, uint8_t n, uint8_t k) {
+    uint32_t laneEnd[PRIME_MAX_OPEN] = {0};
+    uint32_t span = 0;
+    for (uint8_t i = 0; i < n; ++i) {
+        uint8_t lane = 0;
+        for (uint8_t j = 1; j < k; ++j) if (laneEnd[j] < laneEnd[lane]) lane = j;
+        laneEnd[lane] += scaledMs(order[i], k) + PRIME_TAIL_MS;
+        if (laneEnd[lane] > span) span = laneEnd[lane];
+    }
+    return span;
+}
+
+uint8_t primeModelPlan(uint8_t n, uint8_t *order, uint32_t &makespanMs) {
+    makespanMs = 0;
+    if (n > BOARD_INGREDIENT_SLOTS) n = BOARD_INGREDIENT_SLOTS;
+    if (!n) return 0;
+    dcPlanLock();
+    flowModelRefresh();
+
+    // Insertion sort, longest line first (n ≤ 30)
+    for (uint8_t i = 0; i < n; ++i) {
+        uint8_t slot = i + 1;
+        uint32_t ms = singleMs(slot);
+        uint8_t j = i;
+        for (; j > 0 && singleMs(order[j - 1]) < ms; --j) order[j] = order[j - 1];
+        order[j] = slot;
+    }
+
+    uint8_t best = 1;
+    makespanMs = makespanFor(order, n, 1);
+    uint8_t maxOpen = n < PRIME_MAX_OPEN ? n : PRIME_MAX_OPEN;
+    for (uint8_t k = 2; k <= maxOpen; ++k) {
+        uint32_t span = makespanFor(order, n, k);
+        if (span < makespanMs) { makespanMs = span; best = k; }
+    }
+    dcPlanUnlock();
+    return best;
+}
+
+void primeModelRecord(uint8_t slot, float numOpen, uint32_t ms) {
+    if (slot < 1 || slot > BOARD_INGREDIENT_SLOTS || !ms) return;
+    ensureLoaded();
+    dcPlanLock();
+    float sample = ms / openScale(slot, numOpen);
+    dcPlanUnlock();
+    portENTER_CRITICAL(&s_primeMux);
+    uint16_t &est = s_prime.ms[slot - 1];
+    uint8_t  &cnt = s_prime.samples[slot - 1];
+    if (sample > est * 2.0f) sample = est * 2.0f;
+    if (sample < est * 0.5f) sample = est * 0.5f;
+    float next = cnt ? est + PRIME_ALPHA * (sample - est) : sample;
+    if (next > PRIME_MAX_MS) next = PRIME_MAX_MS;
+    est = (uint16_t)(next + 0.5f);
+    if (cnt < 255) ++cnt;
+    s_dirty = true;
+    uint16_t now = est;
+    portEXIT_CRITICAL(&s_primeMux);
+    Serial.printf("[PRIME] Slot %u reached the spout after %u ms (%.1f open) → %u ms learned\n",
+                  (unsigned)slot, (unsigned)ms, numOpen, (unsigned)now);
+}
+
+void primeModelRecordAtLeast(uint8_t slot, float numOpen, uint32_t ms) {
+    if (slot < 1 || slot > BOARD_INGREDIENT_SLOTS || !ms) return;
+    ensureLoaded();
+    dcPlanLock();
+    float bound = ms / openScale(slot, numOpen);
+    dcPlanUnlock();
+    portENTER_CRITICAL(&s_primeMux);
+    uint16_t &est = s_prime.ms[slot - 1];
+    uint16_t was = est;
+    float next = est * (PRIME_GROW_PCT / 100.0f);
+    if (bound < next) next = bound;
+    if (next > PRIME_MAX_MS) next = PRIME_MAX_MS;
+    if (next > est) {
+        est = (uint16_t)(next + 0.5f);
+        s_dirty = true;
+    }
+    uint16_t now = est;
+    portEXIT_CRITICAL(&s_primeMux);
+    Serial.printf("[PRIME] Slot %u not at the spout after %u ms (%.1f open) → %u ms (was %u)\n",
+                  (unsigned)slot, (unsigned)ms, numOpen, (unsigned)now, (unsigned)was);
+}
+
+void primeModelSave() {
+    PrimeState st;
+    portENTER_CRITICAL(&s_primeMux);
+    bool dirty = s_dirty;
+    s_dirty = false;
+    st = s_prime;
+    portEXIT_CRITICAL(&s_primeMux);
+    if (!dirty) return;
+    Preferences prefs;
+    if (!prefs.begin("primemodel", false)) return;
+    prefs.putBytes("state", &st, sizeof(st));
+    prefs.end();
+}
+
+void primeModelToJson(JsonObject out) {
+    ensureLoaded();
+    portENTER_CRITICAL(&s_primeMux);
+    PrimeState st = s_prime;
+    portEXIT_CRITICAL(&s_primeMux);
+    JsonArray ms = out.createNestedArray("ms");
+    JsonArray samples = out.createNestedArray("samples");
+    for (uint8_t i = 0; i < BOARD_INGREDIENT_SLOTS; ++i) {
+        ms.add(st.ms[i]);
+        samples.add(st.samples[i]);
+    }
+    uint8_t order[BOARD_INGREDIENT_SLOTS];
+    uint32_t span;
+    out["open"]    = primeModelPlan(dcGetIngredientCount(), order, span);
+    out["plan_ms"] = span;
+}
+
+void primeModelReset() {
+    PrimeState st;
+    setDefaults(st);
+    portENTER_CRITICAL(&s_primeMux);
+    s_prime = st;
+    s_loaded = true;
+    s_dirty = true;
+    portEXIT_CRITICAL(&s_primeMux);
+    primeModelSave();
+    Serial.println("[PRIME] Prime times reset to defaults");
+}
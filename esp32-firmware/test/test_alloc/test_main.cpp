@@ -0,0 +1,145 @@
+/*
+ * -----------------------------------------------------------------------------
+ *  Project: Liquor Bot
+ *  File: test_main.cpp  (pio test -e native)
+ *  Description: Host test: the command → dispenseParallelGroup path – parse,
+ *               priority sort and group split (the helpers pourDrink calls),
+ *               timeline plan, mass profile – makes no heap allocation. operator new is replaced and
+ *               malloc/calloc/realloc are wrapped at link time (-Wl,--wrap),
+ *               so any allocation between mark() and allocs() is counted.
+ * -----------------------------------------------------------------------------
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "drink_command.h"
+#include "pour_planner.h"
+
+/* ------------------------------ allocation hooks ------------------------------ */
+static unsigned s_allocs = 0;
+
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+void *__wrap_malloc(size_t n)              { ++s_allocs; return __real_malloc(n); }
+void *__wrap_calloc(size_t n, size_t size) { ++s_allocs; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t n)    { ++s_allocs; return __real_realloc(p, n); }
+}
+
+static void *counted(size_t n) {
+    ++s_allocs;
+    void *p = __real_malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new(size_t n)                                 { return counted(n); }
+void *operator new[](size_t n)                               { return counted(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept   { ++s_allocs; return __real_malloc(n ? n : 1); }
+void *operator new[](size_t n, const std::nothrow_t &) noexcept { ++s_allocs; return __real_malloc(n ? n : 1); }
+void operator delete(void *p) noexcept           { free(p); }
+void operator delete[](void *p) noexcept         { free(p); }
+void operator delete(void *p, size_t) noexcept   { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+static void     mark()   { s_allocs = 0; }
+static unsigned allocs() { return s_allocs; }
+
+/* ------------------------------ fixtures ------------------------------ */
+// Per-valve flow (oz/s) with n valves open: total pump flow saturates as in the
+// calibrated curve, so the planner has a real concurrency choice to make
+static float flowOz(int slot, int numOpen) {
+    float total = 2.0f * numOpen / (1.0f + 0.5f * numOpen);
+    return total / numOpen * (1.0f + 0.05f * (slot % 3));
+}
+static float gramsPerOz(int) { return 29.6f; }
+
+void setUp() {}
+void tearDown() {}
+
+/* ------------------------------ tests ------------------------------ */
+static void test_parse_allocates_nothing() {
+    DrinkRecipe r;
+    mark();
+    bool ok = parseDrinkCommand("1:1.5:0, 2:0.75:0,3:2:1,4:0.5", r);
+    TEST_ASSERT_EQUAL_UINT(0, allocs());
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_EQUAL_UINT8(4, r.count);
+    TEST_ASSERT_EQUAL_INT(2, r.items[1].slot);
+    TEST_ASSERT_EQUAL_FLOAT(0.75f, r.items[1].amount);
+    TEST_ASSERT_EQUAL_INT(1, r.items[2].priority);
+    TEST_ASSERT_EQUAL_INT(99, r.items[3].priority);   // default priority
+}
+
+static void test_parse_overflow_reports_false() {
+    char cmd[256] = "";
+    for (int s = 1; s <= DRINK_MAX_ITEMS + 1; ++s) {
+        char item[16];
+        snprintf(item, sizeof(item), "%s%d:0.5", s > 1 ? "," : "", s);
+        strcat(cmd, item);
+    }
+    DrinkRecipe r;
+    mark();
+    bool ok = parseDrinkCommand(cmd, r);
+    TEST_ASSERT_EQUAL_UINT(0, allocs());
+    TEST_ASSERT_FALSE(ok);
+    TEST_ASSERT_EQUAL_UINT8(DRINK_MAX_ITEMS, r.count);
+}
+
+static void test_sort_and_group_split() {
+    DrinkRecipe r;
+    TEST_ASSERT_TRUE(parseDrinkCommand("5:1.5:1,1:2:0,2:0.5:0,3:1:0,4:0.25:1,6:0.75:2", r));
+    mark();
+    sortByPriority(r.items, r.count);
+    TEST_ASSERT_EQUAL_UINT(0, allocs());
+    for (uint8_t k = 1; k < r.count; ++k) TEST_ASSERT_TRUE(r.items[k - 1].priority <= r.items[k].priority);
+    TEST_ASSERT_EQUAL_UINT8(3, priorityGroupLength(r.items, r.count));
+    TEST_ASSERT_EQUAL_UINT8(2, priorityGroupLength(r.items + 3, r.count - 3));
+    TEST_ASSERT_EQUAL_UINT8(1, priorityGroupLength(r.items + 5, 1));
+    TEST_ASSERT_EQUAL_UINT8(0, priorityGroupLength(r.items, 0));
+}
+
+// pourDrink's path between the command and each dispenseParallelGroup call
+static void test_command_to_group_plans_allocates_nothing() {
+    static DrinkRecipe r;
+    static PourPlan    plan;
+    static float       grams[PLAN_MAX_EVENTS];
+    mark();
+    TEST_ASSERT_TRUE(parseDrinkCommand("5:1.5:1,1:2:0,2:0.5:0,3:1:0,4:0.25:1,6:0.75:2", r));
+    sortByPriority(r.items, r.count);
+    uint8_t i = 0, groups = 0;
+    while (i < r.count) {
+        uint8_t n = priorityGroupLength(r.items + i, r.count - i);
+        TEST_ASSERT_TRUE(planGroupMinMakespan(r.items + i, n, flowOz, plan));
+        TEST_ASSERT_EQUAL_UINT8(2 * n, plan.count);
+        planMassProfile(plan, flowOz, gramsPerOz, grams);
+        TEST_ASSERT_TRUE(planTimeForMass(plan, grams, grams[plan.count - 1] / 2.0f) <= plan.makespanUs);
+        i += n;
+        ++groups;
+    }
+    TEST_ASSERT_EQUAL_UINT(0, allocs());
+    TEST_ASSERT_EQUAL_UINT8(3, groups);
+}
+
+// The hooks themselves must see an allocation, or the zeros above prove nothing
+static void test_hooks_count_allocations() {
+    mark();
+    int *volatile p = new int(1);     // volatile: the pair may not be elided
+    void *volatile m = malloc(8);
+    TEST_ASSERT_EQUAL_UINT(2, allocs());
+    delete p;
+    free(m);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_hooks_count_allocations);
+    RUN_TEST(test_parse_allocates_nothing);
+    RUN_TEST(test_parse_overflow_reports_false);
+    RUN_TEST(test_sort_and_group_split);
+    RUN_TEST(test_command_to_group_plans_allocates_nothing);
+    return UNITY_END();
+}